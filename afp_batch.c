@@ -0,0 +1,361 @@
+// Batch validation of many files on a thread pool
+#include "afp_internal.h"
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+// Batch validation: many files are validated by a pool of worker threads.
+// Jobs are dealt largest-first to per-worker queues; a worker whose queue
+// runs dry steals the smallest pending job from another queue, so a few huge
+// files do not leave the rest of the pool idle. Each file's report is
+// captured separately and printed in input order.
+typedef struct {
+    const char *filename;
+    uint64_t size;
+    ValidationResult result;
+    char *report;
+    size_t report_length;
+    FingerprintList fingerprints;
+    bool done;
+} BatchJob;
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t *jobs; // Indices into Batch.jobs, largest first
+    size_t head;
+    size_t tail;
+} WorkQueue;
+
+typedef struct {
+    BatchJob *jobs;
+    size_t job_count;
+    WorkQueue *queues;
+    int worker_count;
+    ValidationOptions options;
+    pthread_mutex_t done_lock;
+    pthread_cond_t done_cond;
+} Batch;
+
+typedef struct {
+    Batch *batch;
+    int id;
+} BatchWorker;
+
+// Per-file exit status reported in the batch summary
+enum {
+    BATCH_STATUS_VALID = 0,
+    BATCH_STATUS_INVALID = 1,
+    BATCH_STATUS_UNREADABLE = 2
+};
+
+static int batch_job_status(const BatchJob *job) {
+    if (!job->result.opened)
+        return BATCH_STATUS_UNREADABLE;
+    return job->result.is_valid ? BATCH_STATUS_VALID : BATCH_STATUS_INVALID;
+}
+
+// Take the next job: own queue from the front, otherwise steal from the back of another
+static bool batch_take_job(Batch *batch, int id, size_t *job) {
+    for (int i = 0; i < batch->worker_count; i++) {
+        WorkQueue *queue = &batch->queues[(id + i) % batch->worker_count];
+        bool found = false;
+
+        pthread_mutex_lock(&queue->lock);
+        if (queue->head < queue->tail) {
+            *job = i == 0 ? queue->jobs[queue->head++] : queue->jobs[--queue->tail];
+            found = true;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        if (found)
+            return true;
+    }
+    return false;
+}
+
+static void batch_run_job(Batch *batch, BatchJob *job) {
+    FILE *report = tmpfile();
+    if (report) {
+        validate_file_fingerprints(job->filename, &batch->options, report, &job->result, &job->fingerprints);
+
+        int64_t length = (int64_t)afp_ftell(report);
+        if (length > 0 && (uint64_t)length <= SIZE_MAX && (job->report = malloc((size_t)length)) != NULL) {
+            rewind(report);
+            job->report_length = fread(job->report, 1, (size_t)length, report);
+        }
+        fclose(report);
+    } else {
+        const char *message = "Error: Cannot create report for ";
+        size_t length = strlen(message) + strlen(job->filename) + 2;
+        if ((job->report = malloc(length)) != NULL)
+            job->report_length = (size_t)snprintf(job->report, length, "%s%s\n", message, job->filename);
+    }
+
+    pthread_mutex_lock(&batch->done_lock);
+    job->done = true;
+    pthread_cond_broadcast(&batch->done_cond);
+    pthread_mutex_unlock(&batch->done_lock);
+}
+
+static void *batch_worker(void *arg) {
+    BatchWorker *worker = arg;
+    size_t job;
+
+    while (batch_take_job(worker->batch, worker->id, &job))
+        batch_run_job(worker->batch, &worker->batch->jobs[job]);
+    return NULL;
+}
+
+static int compare_jobs_by_size(const void *a, const void *b) {
+    const BatchJob *job_a = *(const BatchJob * const *)a;
+    const BatchJob *job_b = *(const BatchJob * const *)b;
+    if (job_a->size != job_b->size)
+        return job_a->size < job_b->size ? 1 : -1;
+    return job_a < job_b ? -1 : (job_a > job_b);
+}
+
+static void print_batch_summary(FILE *out, const BatchJob *jobs, size_t job_count) {
+    size_t counts[3] = {0};
+    for (size_t i = 0; i < job_count; i++)
+        counts[batch_job_status(&jobs[i])]++;
+
+    fprintf(out, "\nBatch Validation Summary:\n");
+    fprintf(out, "------------------------\n");
+    fprintf(out, "Files validated: %zu\n", job_count);
+    fprintf(out, "Valid: %zu  Invalid: %zu  Unreadable: %zu\n\n",
+            counts[BATCH_STATUS_VALID], counts[BATCH_STATUS_INVALID], counts[BATCH_STATUS_UNREADABLE]);
+
+    fprintf(out, "%-10s %-4s %-10s %-7s %s\n", "Status", "Exit", "Fields", "Errors", "File");
+    for (size_t i = 0; i < job_count; i++) {
+        const BatchJob *job = &jobs[i];
+        int status = batch_job_status(job);
+        const char *label = status == BATCH_STATUS_VALID ? "VALID"
+                          : status == BATCH_STATUS_INVALID ? "INVALID" : "UNREADABLE";
+        fprintf(out, "%-10s %-4d %-10llu %-7llu %s\n", label, status, (unsigned long long)job->result.field_count,
+                (unsigned long long)job->result.error_count, job->filename);
+    }
+}
+
+// Resources that several inputs (or one input several times) carry inline
+#define DUPLICATE_LIST_LIMIT 50
+
+static void print_duplicates(FILE *out, const BatchJob *jobs, const DuplicateReport *report,
+                             const CodePage *codepage) {
+    char name[EBCDIC_NAME_SIZE];
+    fprintf(out, "\nDuplicate Resources:\n");
+    fprintf(out, "-------------------\n");
+    fprintf(out, "Inline resources hashed: %zu (%llu bytes), %zu distinct\n", report->resources,
+            (unsigned long long)report->bytes, report->distinct);
+    fprintf(out, "Identical copies: %zu in %zu groups\n", report->copies, report->group_count);
+    fprintf(out, "Bytes saved by moving duplicates to a resource library: %llu\n",
+            (unsigned long long)report->saved);
+    if (report->group_count == 0)
+        return;
+
+    fprintf(out, "\n%-12s %-6s %-5s %-12s %-8s %-16s %s\n", "Saved", "Copies", "Files", "Class", "Name", "XXH64",
+            "First copy");
+    for (size_t i = 0; i < report->group_count && i < DUPLICATE_LIST_LIMIT; i++) {
+        const DuplicateGroup *group = &report->groups[i];
+        fingerprint_name(&group->print, codepage, name);
+        fprintf(out, "%-12llu %-6zu %-5zu %-12s %-8s %016llX %s\n", (unsigned long long)group->saved,
+                group->copies, group->files, get_resource_class_name((ResourceClass)group->print.resource_class),
+                name, (unsigned long long)group->print.hash, jobs[group->file].filename);
+    }
+    if (report->group_count > DUPLICATE_LIST_LIMIT)
+        fprintf(out, "... and %zu more\n", report->group_count - DUPLICATE_LIST_LIMIT);
+}
+
+static void json_duplicates(JSONWriter *json, const BatchJob *jobs, const DuplicateReport *report,
+                            const CodePage *codepage) {
+    char hash[17];
+    char name[EBCDIC_NAME_SIZE];
+    json_object(json, "duplicates");
+    json_uint(json, "resources", report->resources);
+    json_uint(json, "bytes", report->bytes);
+    json_uint(json, "distinct", report->distinct);
+    json_uint(json, "copies", report->copies);
+    json_uint(json, "saved_bytes", report->saved);
+    json_array(json, "groups");
+    for (size_t i = 0; i < report->group_count; i++) {
+        const DuplicateGroup *group = &report->groups[i];
+        fingerprint_name(&group->print, codepage, name);
+        snprintf(hash, sizeof(hash), "%016llX", (unsigned long long)group->print.hash);
+        json_object(json, NULL);
+        json_string(json, "name", name);
+        json_string(json, "class", get_resource_class_name((ResourceClass)group->print.resource_class));
+        json_string(json, "xxh64", hash);
+        json_uint(json, "size", group->print.size);
+        json_uint(json, "copies", group->copies);
+        json_uint(json, "files", group->files);
+        json_uint(json, "saved_bytes", group->saved);
+        json_string(json, "first_file", jobs[group->file].filename);
+        json_close(json, '}');
+    }
+    json_close(json, ']');
+    json_close(json, '}');
+}
+
+// Batch totals as one JSON object
+static void print_batch_json(FILE *out, const BatchJob *jobs, size_t job_count, const DuplicateReport *duplicates,
+                             const CodePage *codepage) {
+    uint64_t counts[3] = {0};
+    for (size_t i = 0; i < job_count; i++)
+        counts[batch_job_status(&jobs[i])]++;
+
+    AFPWriter writer;
+    JSONWriter json;
+    writer_init(&writer, out);
+    json_begin(&json, &writer);
+    json_string(&json, "event", "batch");
+    json_uint(&json, "files", job_count);
+    json_uint(&json, "valid", counts[BATCH_STATUS_VALID]);
+    json_uint(&json, "invalid", counts[BATCH_STATUS_INVALID]);
+    json_uint(&json, "unreadable", counts[BATCH_STATUS_UNREADABLE]);
+    if (duplicates)
+        json_duplicates(&json, jobs, duplicates, codepage);
+    json_end(&json);
+    writer_flush(&writer);
+}
+
+// Validate files on a pool of threads. Returns the worst per-file status.
+int validate_batch(const char **filenames, size_t count, const ValidationOptions *options, FILE *out) {
+    if (count == 0)
+        return BATCH_STATUS_VALID; // Nothing to validate, nothing to report
+
+    Batch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.job_count = count;
+    batch.options = *options;
+    batch.options.threads = 1; // The pool already spreads files over the cores
+    batch.worker_count = options->threads < 1 ? 1 : options->threads;
+    if ((size_t)batch.worker_count > count)
+        batch.worker_count = (int)count;
+
+    batch.jobs = calloc(count, sizeof(BatchJob));
+    batch.queues = calloc((size_t)batch.worker_count, sizeof(WorkQueue));
+    BatchJob **order = malloc(count * sizeof(BatchJob *));
+    BatchWorker *workers = malloc((size_t)batch.worker_count * sizeof(BatchWorker));
+    pthread_t *tids = malloc((size_t)batch.worker_count * sizeof(pthread_t));
+    bool allocated = batch.jobs && batch.queues && order && workers && tids;
+    size_t per_queue = (count + (size_t)batch.worker_count - 1) / (size_t)batch.worker_count;
+    for (int w = 0; allocated && w < batch.worker_count; w++) {
+        batch.queues[w].jobs = malloc(per_queue * sizeof(size_t));
+        allocated = batch.queues[w].jobs != NULL;
+    }
+    if (!allocated) {
+        fprintf(out, "Error: Memory allocation failed\n");
+        for (int w = 0; batch.queues && w < batch.worker_count; w++)
+            free(batch.queues[w].jobs);
+        free(batch.jobs);
+        free(batch.queues);
+        free(order);
+        free(workers);
+        free(tids);
+        return BATCH_STATUS_UNREADABLE;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        struct stat st;
+        batch.jobs[i].filename = filenames[i];
+        if (strcmp(filenames[i], "-") != 0 && stat(filenames[i], &st) == 0)
+            batch.jobs[i].size = (uint64_t)st.st_size;
+        order[i] = &batch.jobs[i];
+    }
+    qsort(order, count, sizeof(BatchJob *), compare_jobs_by_size);
+
+    // Deal jobs round-robin so every queue starts with a similar share of bytes
+    for (int w = 0; w < batch.worker_count; w++)
+        pthread_mutex_init(&batch.queues[w].lock, NULL);
+    for (size_t i = 0; i < count; i++) {
+        WorkQueue *queue = &batch.queues[i % (size_t)batch.worker_count];
+        queue->jobs[queue->tail++] = (size_t)(order[i] - batch.jobs);
+    }
+    free(order);
+
+    pthread_mutex_init(&batch.done_lock, NULL);
+    pthread_cond_init(&batch.done_cond, NULL);
+
+    int started = 0;
+    for (int w = 0; w < batch.worker_count; w++) {
+        workers[w].batch = &batch;
+        workers[w].id = w;
+        if (pthread_create(&tids[w], NULL, batch_worker, &workers[w]) != 0)
+            break;
+        started++;
+    }
+    if (started == 0) {
+        // No threads available: run the whole batch on this one
+        workers[0].batch = &batch;
+        workers[0].id = 0;
+        batch_worker(&workers[0]);
+    }
+
+    // Print reports in input order as soon as each one is complete
+    for (size_t i = 0; i < count; i++) {
+        BatchJob *job = &batch.jobs[i];
+
+        pthread_mutex_lock(&batch.done_lock);
+        while (!job->done)
+            pthread_cond_wait(&batch.done_cond, &batch.done_lock);
+        pthread_mutex_unlock(&batch.done_lock);
+
+        if (job->report)
+            fwrite(job->report, 1, job->report_length, out);
+        free(job->report);
+        job->report = NULL;
+        fflush(out);
+    }
+
+    for (int w = 0; w < started; w++)
+        pthread_join(tids[w], NULL);
+
+    // Identical inline resources across the batch
+    DuplicateReport duplicates;
+    bool found = false;
+    if (options->fingerprint) {
+        FingerprintList *lists = malloc(count * sizeof(FingerprintList));
+        if (lists) {
+            for (size_t i = 0; i < count; i++)
+                lists[i] = batch.jobs[i].fingerprints;
+            found = duplicates_find(lists, count, &duplicates);
+            free(lists);
+        }
+    }
+
+    // Names of resources from different files are shown in the code page of the run
+    const CodePage *codepage = codepage_find((unsigned)options->codepage);
+    if (!codepage)
+        codepage = codepage_find(CODEPAGE_DEFAULT);
+    if (options->format == AFP_REPORT_TEXT) {
+        print_batch_summary(out, batch.jobs, count);
+        if (found)
+            print_duplicates(out, batch.jobs, &duplicates, codepage);
+        else if (options->fingerprint)
+            fprintf(out, "Warning: Not enough memory to compare resource fingerprints\n");
+    } else {
+        print_batch_json(out, batch.jobs, count, found ? &duplicates : NULL, codepage);
+    }
+    if (found)
+        duplicates_free(&duplicates);
+
+    int worst = BATCH_STATUS_VALID;
+    for (size_t i = 0; i < count; i++) {
+        int status = batch_job_status(&batch.jobs[i]);
+        if (status > worst)
+            worst = status;
+    }
+
+    for (int w = 0; w < batch.worker_count; w++) {
+        pthread_mutex_destroy(&batch.queues[w].lock);
+        free(batch.queues[w].jobs);
+    }
+    for (size_t i = 0; i < count; i++)
+        fingerprints_free(&batch.jobs[i].fingerprints);
+    pthread_mutex_destroy(&batch.done_lock);
+    pthread_cond_destroy(&batch.done_cond);
+    free(batch.queues);
+    free(batch.jobs);
+    free(workers);
+    free(tids);
+    return worst;
+}
@@ -0,0 +1,82 @@
+// Restart checkpoints. A serial pass saves its state at a field boundary
+// every interval bytes, in <afp_file>.afpckpt: the summary the index keeps,
+// with the resource names later fields are checked against, plus the open
+// page.
+// A resumed run loads it and continues at the saved position. Only a run
+// with the same settings resumes; the error limit is not one of them, so a
+// run stopped by it can be resumed with a higher one.
+#include "afp_internal.h"
+
+#define CHECKPOINT_MAGIC "AFPCKP01"
+#define CHECKPOINT_VERSION 2
+
+// Save the state of the pass, which has checked every field before position
+bool checkpoint_write(Checkpoint *checkpoint, ValidationState *state, uint64_t position) {
+    checkpoint->next = position + checkpoint->interval;
+    if (checkpoint->failed)
+        return false;
+
+    char *temp;
+    FILE *file = sidecar_create(checkpoint->path, &temp);
+    if (!file) {
+        checkpoint->failed = true;
+        return false;
+    }
+
+    fwrite(CHECKPOINT_MAGIC, 1, 8, file);
+    put_u64(file, CHECKPOINT_VERSION);
+    put_u64(file, checkpoint->identity.size);
+    put_u64(file, (uint64_t)checkpoint->identity.mtime);
+    put_u64(file, checkpoint->identity.sample_hash);
+    put_u64(file, state_settings(state));
+    put_u64(file, position);
+    state_write_summary(file, state);
+    put_u64(file, state->document_seen);
+    put_u64(file, state->stats.page_open);
+    put_u64(file, state->stats.page_start);
+
+    if (!sidecar_commit(file, checkpoint->path, temp))
+        checkpoint->failed = true;
+    return !checkpoint->failed;
+}
+
+// Load a checkpoint of the file and options of this run into state, which
+// is fresh, and return the position to continue at. state is left untouched
+// on failure.
+bool checkpoint_read(const Checkpoint *checkpoint, ValidationState *state, uint64_t *position) {
+    FILE *file = fopen(checkpoint->path, "rb");
+    if (!file)
+        return false;
+
+    char magic[8];
+    uint64_t header[6];
+    bool ok = fread(magic, 1, 8, file) == 8 && memcmp(magic, CHECKPOINT_MAGIC, 8) == 0;
+    for (int i = 0; ok && i < 6; i++)
+        ok = get_u64(file, &header[i]);
+    ok = ok && header[0] == CHECKPOINT_VERSION && header[1] == checkpoint->identity.size &&
+         (int64_t)header[2] == checkpoint->identity.mtime && header[3] == checkpoint->identity.sample_hash &&
+         header[4] == state_settings(state) && header[5] <= checkpoint->identity.size;
+
+    ValidationState loaded = *state;
+    ok = ok && state_read_summary(file, &loaded);
+
+    uint64_t seen, page_open, page_start;
+    ok = ok && get_u64(file, &seen) && get_u64(file, &page_open) && get_u64(file, &page_start);
+    if (ok) {
+        loaded.document_seen = seen != 0; // Reading the summary set it
+        loaded.stats.page_open = page_open != 0;
+        loaded.stats.page_start = page_start;
+    }
+    fclose(file);
+
+    if (ok) {
+        *state = loaded;
+        *position = header[5];
+    } else {
+        if (loaded.containers.items != state->containers.items)
+            containers_free(&loaded.containers);
+        if (loaded.resources.entries != state->resources.entries)
+            resources_free(&loaded.resources);
+    }
+    return ok;
+}
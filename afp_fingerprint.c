@@ -0,0 +1,142 @@
+// Content fingerprints of inline resources and the duplicates among them.
+// Each outermost BRS ... ERS, BMO ... EMO or BPS ... EPS span is hashed as it
+// is scanned, so no resource is ever copied or read twice.
+#include "afp_internal.h"
+
+// Feed one field to the span being hashed, opening or closing it as needed
+void fingerprint_field(FingerprintSpan *span, FingerprintList *list, const StructuredField *field,
+                       const unsigned char *bytes, size_t size, uint64_t position) {
+    if (!span->open) {
+        ResourceClass resource_class;
+        if (field->length < 16 || !resource_definition(field, &resource_class))
+            return;
+        span->open = true;
+        span->end = sf_pair(field->id);
+        xxh64_init(&span->hash, 0);
+        memset(&span->print, 0, sizeof(span->print));
+        span->print.offset = position;
+        span->print.resource_class = (unsigned char)resource_class;
+        memcpy(span->print.name, field->data + 2, 8);
+    } else if (span->print.resource_class == RESOURCE_ANY && field->length >= 16) {
+        // An untyped BRS takes the class of the overlay or segment it wraps
+        ResourceClass resource_class;
+        if (resource_definition(field, &resource_class))
+            span->print.resource_class = (unsigned char)resource_class;
+    }
+
+    xxh64_update(&span->hash, bytes, size);
+    span->print.size += size;
+    if (field->id != span->end)
+        return;
+
+    span->open = false;
+    span->print.hash = xxh64_digest(&span->hash);
+    if (array_reserve((void **)&list->items, &list->capacity, list->count + 1, sizeof(ResourceFingerprint)))
+        list->items[list->count++] = span->print;
+}
+
+bool fingerprints_append(FingerprintList *dst, const FingerprintList *src) {
+    if (!array_reserve((void **)&dst->items, &dst->capacity, dst->count + src->count, sizeof(ResourceFingerprint)))
+        return false;
+    if (src->count > 0)
+        memcpy(dst->items + dst->count, src->items, src->count * sizeof(ResourceFingerprint));
+    dst->count += src->count;
+    return true;
+}
+
+void fingerprints_free(FingerprintList *list) {
+    free(list->items);
+    memset(list, 0, sizeof(*list));
+}
+
+void fingerprint_name(const ResourceFingerprint *print, const CodePage *codepage, char name[EBCDIC_NAME_SIZE]) {
+    ebcdic_name(codepage, print->name, 8, name);
+}
+
+// Duplicates across files: fingerprints are sorted by hash and size, so
+// byte-identical resources end up next to each other
+typedef struct {
+    const ResourceFingerprint *print;
+    size_t file;
+} FingerprintRef;
+
+static int compare_refs(const void *a, const void *b) {
+    const FingerprintRef *x = a, *y = b;
+    if (x->print->hash != y->print->hash)
+        return x->print->hash < y->print->hash ? -1 : 1;
+    if (x->print->size != y->print->size)
+        return x->print->size < y->print->size ? -1 : 1;
+    if (x->file != y->file)
+        return x->file < y->file ? -1 : 1;
+    return (x->print->offset > y->print->offset) - (x->print->offset < y->print->offset);
+}
+
+static int compare_groups(const void *a, const void *b) {
+    const DuplicateGroup *x = a, *y = b;
+    if (x->saved != y->saved)
+        return x->saved < y->saved ? 1 : -1;
+    return (x->file > y->file) - (x->file < y->file);
+}
+
+bool duplicates_find(const FingerprintList *lists, size_t list_count, DuplicateReport *report) {
+    memset(report, 0, sizeof(*report));
+    size_t total = 0;
+    for (size_t i = 0; i < list_count; i++)
+        total += lists[i].count;
+    if (total == 0)
+        return true;
+
+    FingerprintRef *refs = malloc(total * sizeof(FingerprintRef));
+    if (!refs)
+        return false;
+    size_t n = 0;
+    for (size_t i = 0; i < list_count; i++) {
+        for (size_t j = 0; j < lists[i].count; j++) {
+            refs[n].print = &lists[i].items[j];
+            refs[n].file = i;
+            report->resources++;
+            report->bytes += lists[i].items[j].size;
+            n++;
+        }
+    }
+    qsort(refs, total, sizeof(FingerprintRef), compare_refs);
+
+    size_t capacity = 0;
+    for (size_t i = 0; i < total;) {
+        size_t j = i + 1;
+        size_t files = 1;
+        while (j < total && refs[j].print->hash == refs[i].print->hash && refs[j].print->size == refs[i].print->size) {
+            if (refs[j].file != refs[j - 1].file)
+                files++;
+            j++;
+        }
+        report->distinct++;
+
+        if (j - i > 1) {
+            if (!array_reserve((void **)&report->groups, &capacity, report->group_count + 1, sizeof(DuplicateGroup))) {
+                free(refs);
+                duplicates_free(report);
+                return false;
+            }
+            DuplicateGroup *group = &report->groups[report->group_count++];
+            group->print = *refs[i].print; // First copy in input order
+            group->file = refs[i].file;
+            group->copies = j - i;
+            group->files = files;
+            group->saved = refs[i].print->size * (uint64_t)(j - i - 1);
+            report->copies += group->copies;
+            report->saved += group->saved;
+        }
+        i = j;
+    }
+    free(refs);
+
+    // Biggest savings first
+    qsort(report->groups, report->group_count, sizeof(DuplicateGroup), compare_groups);
+    return true;
+}
+
+void duplicates_free(DuplicateReport *report) {
+    free(report->groups);
+    memset(report, 0, sizeof(*report));
+}
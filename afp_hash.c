@@ -0,0 +1,116 @@
+// XXH64 content hash, streaming form. Four independent 64-bit lanes per
+// 32-byte stripe keep the multiplier units busy; the result matches the
+// reference XXH64 with the same seed.
+#include "afp_internal.h"
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2CA63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t xxh_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Little-endian loads; compilers turn these into single moves
+static inline uint32_t xxh_read32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t xxh_read64(const unsigned char *p) {
+    return (uint64_t)xxh_read32(p) | (uint64_t)xxh_read32(p + 4) << 32;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = xxh_rotl(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t lane) {
+    acc ^= xxh_round(0, lane);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+void xxh64_init(XXH64State *state, uint64_t seed) {
+    memset(state, 0, sizeof(*state));
+    state->lanes[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    state->lanes[1] = seed + XXH_PRIME64_2;
+    state->lanes[2] = seed;
+    state->lanes[3] = seed - XXH_PRIME64_1;
+}
+
+static const unsigned char *xxh64_stripes(uint64_t lanes[4], const unsigned char *p, const unsigned char *end) {
+    uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+    while (end - p >= 32) {
+        v1 = xxh_round(v1, xxh_read64(p));
+        v2 = xxh_round(v2, xxh_read64(p + 8));
+        v3 = xxh_round(v3, xxh_read64(p + 16));
+        v4 = xxh_round(v4, xxh_read64(p + 24));
+        p += 32;
+    }
+    lanes[0] = v1; lanes[1] = v2; lanes[2] = v3; lanes[3] = v4;
+    return p;
+}
+
+void xxh64_update(XXH64State *state, const void *data, size_t length) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + length;
+    state->total += length;
+
+    // Complete a stripe held back by the previous call
+    if (state->buffered > 0) {
+        size_t take = 32 - state->buffered;
+        if (take > length)
+            take = length;
+        memcpy(state->buffer + state->buffered, p, take);
+        state->buffered += take;
+        p += take;
+        if (state->buffered < 32)
+            return;
+        xxh64_stripes(state->lanes, state->buffer, state->buffer + 32);
+        state->buffered = 0;
+    }
+
+    p = xxh64_stripes(state->lanes, p, end);
+    memcpy(state->buffer, p, (size_t)(end - p));
+    state->buffered = (size_t)(end - p);
+}
+
+uint64_t xxh64_digest(const XXH64State *state) {
+    uint64_t h;
+    if (state->total >= 32) {
+        const uint64_t *v = state->lanes;
+        h = xxh_rotl(v[0], 1) + xxh_rotl(v[1], 7) + xxh_rotl(v[2], 12) + xxh_rotl(v[3], 18);
+        for (int i = 0; i < 4; i++)
+            h = xxh_merge(h, v[i]);
+    } else {
+        h = state->lanes[2] + XXH_PRIME64_5; // The seed
+    }
+    h += state->total;
+
+    const unsigned char *p = state->buffer;
+    size_t left = state->buffered;
+    for (; left >= 8; p += 8, left -= 8) {
+        h ^= xxh_round(0, xxh_read64(p));
+        h = xxh_rotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (left >= 4) {
+        h ^= (uint64_t)xxh_read32(p) * XXH_PRIME64_1;
+        h = xxh_rotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+        left -= 4;
+    }
+    for (; left > 0; p++, left--) {
+        h ^= (uint64_t)*p * XXH_PRIME64_5;
+        h = xxh_rotl(h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,599 @@
+// Offset index: collection during a scan, the .afpidx sidecar file and
+// page lookups
+#include "afp_internal.h"
+
+#include <sys/stat.h>
+
+// Make room for needed items in a growable array
+bool array_reserve(void **items, size_t *capacity, size_t needed, size_t item_size) {
+    if (needed <= *capacity)
+        return true;
+
+    size_t new_capacity = *capacity ? *capacity : 64;
+    while (new_capacity < needed)
+        new_capacity *= 2;
+
+    void *grown = realloc(*items, new_capacity * item_size);
+    PERF_COUNT(allocations, 1);
+    if (!grown)
+        return false;
+    *items = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+void put_le(unsigned char *p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        p[i] = (unsigned char)(value >> (8 * i));
+}
+
+uint64_t get_le(const unsigned char *p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+void index_free(AFPIndex *index) {
+    free(index->records);
+    free(index->pages);
+    free(index->documents);
+    memset(index, 0, sizeof(*index));
+}
+
+static bool index_open_range(AFPIndex *index, IndexRange **ranges, size_t *count, size_t *capacity,
+                             uint64_t position) {
+    if (!array_reserve((void **)ranges, capacity, *count + 1, sizeof(IndexRange))) {
+        index->failed = true;
+        return false;
+    }
+    (*ranges)[*count].start = position;
+    (*ranges)[*count].end = 0;
+    (*count)++;
+    return true;
+}
+
+static void index_close_range(IndexRange *ranges, size_t count, uint64_t *orphan_end, uint64_t end) {
+    if (count > 0 && ranges[count - 1].end == 0)
+        ranges[count - 1].end = end;
+    else if (*orphan_end == 0)
+        *orphan_end = end;
+}
+
+// Record a structured field found at position
+void index_add_field(AFPIndex *index, uint64_t position, const StructuredField *field, size_t field_size) {
+    if (index->failed)
+        return;
+
+    if (field->id == SF_BPG) {
+        if (!index_open_range(index, &index->pages, &index->page_count, &index->page_capacity, position))
+            return;
+        index->current_page = (uint32_t)index->page_count;
+    } else if (field->id == SF_BDT) {
+        if (!index_open_range(index, &index->documents, &index->document_count, &index->document_capacity, position))
+            return;
+    } else if (field->id == SF_EDT) {
+        index_close_range(index->documents, index->document_count, &index->orphan_document_end,
+                          position + field_size);
+    }
+
+    if (!array_reserve((void **)&index->records, &index->record_capacity, index->record_count + 1,
+                       INDEX_RECORD_SIZE)) {
+        index->failed = true;
+        return;
+    }
+    unsigned char *record = index->records + index->record_count++ * INDEX_RECORD_SIZE;
+    put_le(record, position, 8);
+    put_le(record + 8, index->current_page, 4);
+    put_le(record + 12, field->length, 2);
+    memcpy(record + 14, field->type, 3);
+    record[17] = field->flags;
+
+    if (field->id == SF_EPG) {
+        if (index->current_page > 0)
+            index->pages[index->current_page - 1].end = position + field_size;
+        else if (index->orphan_page_end == 0)
+            index->orphan_page_end = position + field_size;
+        index->current_page = 0;
+    }
+}
+
+// Append the index of the chunk that follows dst in the file
+void index_append(AFPIndex *dst, const AFPIndex *src) {
+    if (dst->failed || src->failed) {
+        dst->failed = true;
+        return;
+    }
+
+    uint64_t unused = 0;
+    if (src->orphan_page_end)
+        index_close_range(dst->pages, dst->page_count, &unused, src->orphan_page_end);
+    if (src->orphan_document_end)
+        index_close_range(dst->documents, dst->document_count, &unused, src->orphan_document_end);
+
+    if (!array_reserve((void **)&dst->records, &dst->record_capacity, dst->record_count + src->record_count,
+                       INDEX_RECORD_SIZE) ||
+        !array_reserve((void **)&dst->pages, &dst->page_capacity, dst->page_count + src->page_count,
+                       sizeof(IndexRange)) ||
+        !array_reserve((void **)&dst->documents, &dst->document_capacity,
+                       dst->document_count + src->document_count, sizeof(IndexRange))) {
+        dst->failed = true;
+        return;
+    }
+
+    // Page numbers continue from the pages already indexed
+    unsigned char *records = dst->records + dst->record_count * INDEX_RECORD_SIZE;
+    memcpy(records, src->records, src->record_count * INDEX_RECORD_SIZE);
+    for (size_t i = 0; i < src->record_count; i++) {
+        unsigned char *page = records + i * INDEX_RECORD_SIZE + 8;
+        uint64_t number = get_le(page, 4);
+        if (number > 0)
+            put_le(page, number + dst->page_count, 4);
+    }
+    dst->record_count += src->record_count;
+
+    memcpy(dst->pages + dst->page_count, src->pages, src->page_count * sizeof(IndexRange));
+    dst->page_count += src->page_count;
+    memcpy(dst->documents + dst->document_count, src->documents, src->document_count * sizeof(IndexRange));
+    dst->document_count += src->document_count;
+}
+
+// Index sidecar file: a header identifying the AFP file and the settings of
+// the run, the validation summary, then the field records and the page and
+// document tables.
+#define INDEX_MAGIC "AFPIDX01"
+#define INDEX_VERSION 6
+#define INDEX_SAMPLE_SIZE 65536
+
+static uint64_t fnv1a(uint64_t hash, const unsigned char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool file_identity(const char *filename, FileIdentity *identity) {
+    struct stat st;
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+
+    FILE *file = fopen(filename, "rb");
+    unsigned char *buffer = malloc(INDEX_SAMPLE_SIZE);
+    if (!file || !buffer) {
+        if (file)
+            fclose(file);
+        free(buffer);
+        return false;
+    }
+
+    identity->size = (uint64_t)st.st_size;
+    identity->mtime = (int64_t)st.st_mtime;
+    identity->sample_hash = fnv1a(0xcbf29ce484222325ULL, buffer, fread(buffer, 1, INDEX_SAMPLE_SIZE, file));
+    if (identity->size > INDEX_SAMPLE_SIZE && afp_fseek(file, -(long)INDEX_SAMPLE_SIZE, SEEK_END) == 0)
+        identity->sample_hash = fnv1a(identity->sample_hash, buffer, fread(buffer, 1, INDEX_SAMPLE_SIZE, file));
+
+    free(buffer);
+    fclose(file);
+    return true;
+}
+
+// Path of a sidecar file next to an AFP file (caller frees)
+char *sidecar_path(const char *filename, const char *extension) {
+    size_t length = strlen(filename) + strlen(extension) + 1;
+    char *path = malloc(length);
+    if (path)
+        snprintf(path, length, "%s%s", filename, extension);
+    return path;
+}
+
+char *index_path(const char *filename) {
+    return sidecar_path(filename, ".afpidx");
+}
+
+// Sidecars are written to a temporary file (*temp, caller frees), then
+// renamed over the old one, so a reader never sees half a file
+FILE *sidecar_create(const char *path, char **temp) {
+    *temp = sidecar_path(path, ".tmp");
+    if (!*temp)
+        return NULL;
+    FILE *file = fopen(*temp, "wb");
+    if (!file) {
+        free(*temp);
+        *temp = NULL;
+    }
+    return file;
+}
+
+bool sidecar_commit(FILE *file, const char *path, char *temp) {
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if (ok) {
+        remove(path); // rename does not replace on every platform
+        ok = rename(temp, path) == 0;
+    }
+    if (!ok)
+        remove(temp);
+    free(temp);
+    return ok;
+}
+
+void put_u64(FILE *file, uint64_t value) {
+    unsigned char bytes[8];
+    put_le(bytes, value, 8);
+    fwrite(bytes, 1, 8, file);
+}
+
+bool get_u64(FILE *file, uint64_t *value) {
+    unsigned char bytes[8];
+    if (fread(bytes, 1, 8, file) != 8)
+        return false;
+    *value = get_le(bytes, 8);
+    return true;
+}
+
+#define STATISTICS_FIELD_COUNT 12
+
+// Counters of AFPStatistics in their serialized order
+static void statistics_fields(AFPStatistics *stats, uint64_t *fields[STATISTICS_FIELD_COUNT]) {
+    fields[0] = &stats->documents;
+    fields[1] = &stats->page_groups;
+    fields[2] = &stats->pages;
+    fields[3] = &stats->overlays;
+    fields[4] = &stats->resource_groups;
+    fields[5] = &stats->presentation_text;
+    fields[6] = &stats->images;
+    fields[7] = &stats->graphics;
+    fields[8] = &stats->barcodes;
+    fields[9] = &stats->fonts;
+    fields[10] = &stats->form_defs;
+    fields[11] = &stats->page_segments;
+}
+
+// Options that change what is counted; a summary saved in the index or a
+// checkpoint only stands for a run with the same ones
+uint64_t state_settings(const ValidationState *state) {
+    uint64_t codepage = state->codepage_fixed ? state->codepage->id : 0;
+    return (uint64_t)state->deep | (codepage << 1);
+}
+
+// Serialize what print_validation_summary reports
+void state_write_summary(FILE *file, ValidationState *state) {
+    put_u64(file, state->is_valid);
+    put_u64(file, state->has_begin_document);
+    put_u64(file, state->has_end_document);
+    put_u64(file, state->field_count);
+    put_u64(file, state->error_count);
+    put_u64(file, state->skipped_bytes);
+    put_u64(file, state->page_count);
+    put_u64(file, state->object_count);
+    put_u64(file, state->resource_count);
+    put_u64(file, state->document_codepage ? state->document_codepage->id : 0);
+
+    uint64_t *fields[STATISTICS_FIELD_COUNT];
+    statistics_fields(&state->stats, fields);
+    for (int i = 0; i < STATISTICS_FIELD_COUNT; i++)
+        put_u64(file, *fields[i]);
+
+    // Types that occur, keyed on their type code
+    const AFPStatistics *stats = &state->stats;
+    uint64_t type_count = 0;
+    for (int id = 0; id < SF_TYPE_COUNT; id++)
+        type_count += stats->types[id].count > 0;
+    put_u64(file, type_count);
+    for (int id = 0; id < SF_TYPE_COUNT; id++) {
+        const FieldTypeStatistics *type = &stats->types[id];
+        if (type->count == 0)
+            continue;
+        put_u64(file, sf_types[id].code);
+        put_u64(file, type->count);
+        put_u64(file, type->bytes);
+        put_u64(file, type->largest);
+        put_u64(file, type->largest_offset);
+        for (int b = 0; b < LENGTH_BUCKETS; b++)
+            put_u64(file, type->lengths[b]);
+    }
+    put_u64(file, stats->largest_page_count);
+    for (size_t i = 0; i < stats->largest_page_count; i++) {
+        put_u64(file, stats->largest_pages[i].number);
+        put_u64(file, stats->largest_pages[i].offset);
+        put_u64(file, stats->largest_pages[i].size);
+    }
+
+    put_u64(file, state->containers.count);
+    for (size_t i = 0; i < state->containers.count; i++) {
+        const OpenContainer *open = &state->containers.items[i];
+        put_u64(file, open->code);
+        put_u64(file, open->offset);
+        put_u64(file, get_le((const unsigned char *)open->name, 8));
+    }
+
+    // Resource definitions and references, for the cross-reference report
+    const ResourceTable *resources = &state->resources;
+    put_u64(file, resources->failed);
+    put_u64(file, resources->count);
+    for (size_t i = 0; i < resources->capacity; i++) {
+        const ResourceEntry *entry = &resources->entries[i];
+        if (!entry->used)
+            continue;
+        put_u64(file, get_le(entry->name, 8));
+        put_u64(file, entry->resource_class);
+        put_u64(file, entry->defined);
+        put_u64(file, entry->references);
+        put_u64(file, entry->definition);
+        put_u64(file, entry->first_reference);
+    }
+}
+
+bool state_read_summary(FILE *file, ValidationState *state) {
+    uint64_t v[10];
+    for (int i = 0; i < 10; i++) {
+        if (!get_u64(file, &v[i]))
+            return false;
+    }
+    state->is_valid = v[0] != 0;
+    state->has_begin_document = v[1] != 0;
+    state->has_end_document = v[2] != 0;
+    state->field_count = v[3];
+    state->error_count = v[4];
+    state->skipped_bytes = v[5];
+    state->page_count = v[6];
+    state->object_count = v[7];
+    state->resource_count = v[8];
+    state_document_codepage(state, v[9] <= UINT16_MAX ? codepage_find((unsigned)v[9]) : NULL);
+
+    uint64_t *fields[STATISTICS_FIELD_COUNT];
+    statistics_fields(&state->stats, fields);
+    for (int i = 0; i < STATISTICS_FIELD_COUNT; i++) {
+        if (!get_u64(file, fields[i]))
+            return false;
+    }
+
+    AFPStatistics *stats = &state->stats;
+    uint64_t type_count, page_count;
+    if (!get_u64(file, &type_count) || type_count > SF_TYPE_COUNT)
+        return false;
+    for (uint64_t i = 0; i < type_count; i++) {
+        uint64_t code;
+        if (!get_u64(file, &code) || code > 0xFFFF)
+            return false;
+        FieldTypeStatistics *type = &stats->types[sf_type_index[code]];
+        if (!get_u64(file, &type->count) || !get_u64(file, &type->bytes) || !get_u64(file, &type->largest) ||
+            !get_u64(file, &type->largest_offset))
+            return false;
+        for (int b = 0; b < LENGTH_BUCKETS; b++) {
+            if (!get_u64(file, &type->lengths[b]))
+                return false;
+        }
+    }
+    if (!get_u64(file, &page_count) || page_count > LARGEST_PAGES)
+        return false;
+    stats->largest_page_count = (size_t)page_count;
+    for (size_t i = 0; i < stats->largest_page_count; i++) {
+        PageSize *page = &stats->largest_pages[i];
+        if (!get_u64(file, &page->number) || !get_u64(file, &page->offset) || !get_u64(file, &page->size))
+            return false;
+    }
+
+    uint64_t depth;
+    if (!get_u64(file, &depth) || depth > state->field_count)
+        return false;
+    state->containers.count = 0;
+    for (uint64_t i = 0; i < depth; i++) {
+        uint64_t code, offset, name;
+        char bytes[9];
+        if (!get_u64(file, &code) || !get_u64(file, &offset) || !get_u64(file, &name) || code >> 8 != 0xA8)
+            return false;
+        put_le((unsigned char *)bytes, name, 8);
+        bytes[8] = '\0';
+        if (!containers_push(&state->containers, (uint16_t)code, offset, bytes))
+            return false;
+    }
+
+    uint64_t failed, count;
+    if (!get_u64(file, &failed) || !get_u64(file, &count) || count > state->field_count)
+        return false;
+    state->resources.failed = failed != 0;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t name, resource_class, defined, references;
+        ResourceEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        if (!get_u64(file, &name) || !get_u64(file, &resource_class) || !get_u64(file, &defined) ||
+            !get_u64(file, &references) || !get_u64(file, &entry.definition) ||
+            !get_u64(file, &entry.first_reference) || resource_class >= RESOURCE_CLASS_COUNT ||
+            references > UINT32_MAX)
+            return false;
+        put_le(entry.name, name, 8);
+        entry.resource_class = (unsigned char)resource_class;
+        entry.defined = defined != 0;
+        entry.references = (uint32_t)references;
+        if (!resources_restore(&state->resources, &entry))
+            return false;
+    }
+    return true;
+}
+
+static void write_ranges(FILE *file, const IndexRange *ranges, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        put_u64(file, ranges[i].start);
+        put_u64(file, ranges[i].end);
+    }
+}
+
+static bool read_ranges(FILE *file, IndexRange **ranges, size_t count) {
+    *ranges = count ? malloc(count * sizeof(IndexRange)) : NULL;
+    if (count && !*ranges)
+        return false;
+    for (size_t i = 0; i < count; i++) {
+        if (!get_u64(file, &(*ranges)[i].start) || !get_u64(file, &(*ranges)[i].end))
+            return false;
+    }
+    return true;
+}
+
+// Write the sidecar atomically (temporary file, then rename)
+bool index_write(const char *path, const FileIdentity *identity, ValidationState *state, const AFPIndex *index) {
+    if (index->failed)
+        return false;
+
+    char *temp;
+    FILE *file = sidecar_create(path, &temp);
+    if (!file)
+        return false;
+
+    fwrite(INDEX_MAGIC, 1, 8, file);
+    put_u64(file, INDEX_VERSION);
+    put_u64(file, identity->size);
+    put_u64(file, (uint64_t)identity->mtime);
+    put_u64(file, identity->sample_hash);
+    put_u64(file, state_settings(state));
+    put_u64(file, index->record_count);
+    put_u64(file, index->page_count);
+    put_u64(file, index->document_count);
+    state_write_summary(file, state);
+    fwrite(index->records, INDEX_RECORD_SIZE, index->record_count, file);
+    write_ranges(file, index->pages, index->page_count);
+    write_ranges(file, index->documents, index->document_count);
+    return sidecar_commit(file, path, temp);
+}
+
+// Load the summary (and, when index is not NULL, the tables) of a sidecar
+// built for the file described by identity. The summary must come from a run
+// with the settings of state; the tables do not depend on them, so a table
+// lookup takes any. state is left untouched on failure.
+bool index_read(const char *path, const FileIdentity *identity, ValidationState *state, AFPIndex *index) {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    char magic[8];
+    uint64_t header[8];
+    bool ok = fread(magic, 1, 8, file) == 8 && memcmp(magic, INDEX_MAGIC, 8) == 0;
+    for (int i = 0; ok && i < 8; i++)
+        ok = get_u64(file, &header[i]);
+    ok = ok && header[0] == INDEX_VERSION && header[1] == identity->size &&
+         (int64_t)header[2] == identity->mtime && header[3] == identity->sample_hash &&
+         (index || header[4] == state_settings(state));
+
+    ValidationState loaded = *state;
+    ok = ok && state_read_summary(file, &loaded);
+
+    if (ok && index) {
+        AFPIndex tables;
+        memset(&tables, 0, sizeof(tables));
+        tables.record_count = (size_t)header[5];
+        tables.page_count = (size_t)header[6];
+        tables.document_count = (size_t)header[7];
+        tables.records = tables.record_count ? malloc(tables.record_count * INDEX_RECORD_SIZE) : NULL;
+        ok = (tables.records || !tables.record_count) &&
+             fread(tables.records, INDEX_RECORD_SIZE, tables.record_count, file) == tables.record_count &&
+             read_ranges(file, &tables.pages, tables.page_count) &&
+             read_ranges(file, &tables.documents, tables.document_count);
+        tables.record_capacity = tables.record_count;
+        tables.page_capacity = tables.page_count;
+        tables.document_capacity = tables.document_count;
+        if (ok)
+            *index = tables;
+        else
+            index_free(&tables);
+    }
+    fclose(file);
+
+    if (ok) {
+        *state = loaded;
+    } else {
+        if (loaded.containers.items != state->containers.items)
+            containers_free(&loaded.containers);
+        if (loaded.resources.entries != state->resources.entries)
+            resources_free(&loaded.resources);
+    }
+    return ok;
+}
+
+// Random access by page: the page table comes from the sidecar index when it
+// is current, otherwise from a walk over the field headers that skips the
+// payloads. Only the selected BPG...EPG range is then validated.
+
+// Index every field header of a file without validating it
+static void index_headers(AFPScanner *scanner, AFPIndex *index) {
+    while (scanner->position < scanner->size && !index->failed) {
+        size_t avail;
+        const unsigned char *p = scanner_peek(scanner, 7, &avail);
+        if (avail < 7)
+            break;
+
+        uint16_t length = (uint16_t)((p[1] << 8) | p[2]);
+        if (p[0] != SF_INTRODUCER || length < 8 || 1 + (uint64_t)length > scanner->size - scanner->position) {
+            if (!scanner_resync(scanner))
+                break;
+            continue;
+        }
+
+        StructuredField field;
+        memset(&field, 0, sizeof(field));
+        field.length = length;
+        memcpy(field.type, p + 3, 3);
+        field.flags = p[6];
+        field.id = sf_type_id(field.type);
+        index_add_field(index, scanner->position, &field, 1 + (size_t)length);
+        scanner_skip(scanner, 1 + (size_t)length);
+    }
+}
+
+// Load the page table of a file into index: from its sidecar when use_index
+// is set and the sidecar is current, otherwise by walking the file through
+// scanner. *from_index tells which one was used.
+bool load_page_table(const char *filename, AFPScanner *scanner, bool use_index, AFPIndex *index,
+                     bool *from_index) {
+    memset(index, 0, sizeof(*index));
+    *from_index = false;
+
+    FileIdentity identity;
+    char *sidecar = use_index && file_identity(filename, &identity) ? index_path(filename) : NULL;
+    if (sidecar) {
+        ValidationOptions options = {.threads = 1, .format = AFP_REPORT_TEXT};
+        ValidationState scratch;
+        state_init(&scratch, NULL, &options, 0);
+        *from_index = index_read(sidecar, &identity, &scratch, index);
+        state_free(&scratch);
+        free(sidecar);
+        if (*from_index)
+            return true;
+    }
+
+    if (scanner->streaming)
+        return false;
+    index_headers(scanner, index);
+    return !index->failed;
+}
+
+// Byte range [*start, *end) of pages first..last (1-based, inclusive).
+// Returns false when the file has fewer pages.
+bool page_range(const AFPIndex *index, uint64_t file_size, uint32_t first, uint32_t last,
+                uint64_t *start, uint64_t *end) {
+    if (first == 0 || last < first || last > index->page_count)
+        return false;
+
+    *start = index->pages[first - 1].start;
+    *end = index->pages[last - 1].end;
+    if (*end == 0) {
+        // Unclosed page: it runs up to the next page or the end of the file
+        *end = last < index->page_count ? index->pages[last].start : file_size;
+    }
+    return true;
+}
+
+bool afp_find_pages(const char *filename, bool use_index, uint32_t first, uint32_t last,
+                    uint64_t *start, uint64_t *end) {
+    AFPScanner scanner;
+    if (!scanner_open(&scanner, filename))
+        return false;
+
+    AFPIndex index;
+    bool from_index;
+    bool found = load_page_table(filename, &scanner, use_index, &index, &from_index) &&
+                 page_range(&index, scanner.size, first, last, start, end);
+    index_free(&index);
+    scanner_close(&scanner);
+    return found;
+}
@@ -0,0 +1,788 @@
+// Internal declarations shared by the library sources. Not installed; the
+// public interface is afpvalidator.h.
+#ifndef AFP_INTERNAL_H
+#define AFP_INTERNAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "afpvalidator.h"
+
+#define SF_INTRODUCER 0x5A
+
+// AFP architecture components
+typedef enum {
+    COMPONENT_UNKNOWN,
+    COMPONENT_DOCUMENT,
+    COMPONENT_PAGE_GROUP,
+    COMPONENT_PAGE,
+    COMPONENT_OBJECT,
+    COMPONENT_RESOURCE_GROUP,
+    COMPONENT_OVERLAY,
+    COMPONENT_RESOURCE
+} AFPComponent;
+
+// AFP data object types
+typedef enum {
+    OBJ_UNKNOWN,
+    OBJ_PRESENTATIONTEXT,
+    OBJ_IMAGE,
+    OBJ_GRAPHICS,
+    OBJ_BARCODE,
+    OBJ_FONT,
+    OBJ_PAGSEG,
+    OBJ_FORMDEF,
+    OBJ_RESLIB
+} AFPObjectType;
+
+// MO:DCA structured field types, keyed on type bytes 1-2 (byte 0 is 0xD3).
+// X(id, code, acronym, name, component, object type, flags)
+#define SF_NAMED 0x01      // Payload starts with an 8-byte name
+#define SF_REFERENCES 0x02 // Payload maps resources by name
+
+#define SF_TYPE_LIST(X) \
+    X(BPS,  0xA85F, "BPS",   "Begin Page Segment",                      COMPONENT_RESOURCE,       OBJ_PAGSEG,           SF_NAMED) \
+    X(EPS,  0xA95F, "EPS",   "End Page Segment",                        COMPONENT_RESOURCE,       OBJ_PAGSEG,           SF_NAMED) \
+    X(BCA,  0xA877, "BCA",   "Begin Color Attribute Table",             COMPONENT_RESOURCE,       OBJ_UNKNOWN,          SF_NAMED) \
+    X(ECA,  0xA977, "ECA",   "End Color Attribute Table",               COMPONENT_RESOURCE,       OBJ_UNKNOWN,          SF_NAMED) \
+    X(BII,  0xA87B, "BII",   "Begin IM Image",                          COMPONENT_OBJECT,         OBJ_IMAGE,            SF_NAMED) \
+    X(EII,  0xA97B, "EII",   "End IM Image",                            COMPONENT_OBJECT,         OBJ_IMAGE,            SF_NAMED) \
+    X(BCP,  0xA887, "BCP",   "Begin Code Page",                         COMPONENT_RESOURCE,       OBJ_FONT,             SF_NAMED) \
+    X(ECP,  0xA987, "ECP",   "End Code Page",                           COMPONENT_RESOURCE,       OBJ_FONT,             SF_NAMED) \
+    X(BFN,  0xA889, "BFN",   "Begin Font",                              COMPONENT_RESOURCE,       OBJ_FONT,             SF_NAMED) \
+    X(EFN,  0xA989, "EFN",   "End Font",                                COMPONENT_RESOURCE,       OBJ_FONT,             SF_NAMED) \
+    X(BCF,  0xA88A, "BCF",   "Begin Coded Font",                        COMPONENT_RESOURCE,       OBJ_FONT,             SF_NAMED) \
+    X(ECF,  0xA98A, "ECF",   "End Coded Font",                          COMPONENT_RESOURCE,       OBJ_FONT,             SF_NAMED) \
+    X(BOC,  0xA892, "BOC",   "Begin Object Container",                  COMPONENT_OBJECT,         OBJ_UNKNOWN,          SF_NAMED) \
+    X(EOC,  0xA992, "EOC",   "End Object Container",                    COMPONENT_OBJECT,         OBJ_UNKNOWN,          SF_NAMED) \
+    X(BPT,  0xA89B, "BPT",   "Begin Presentation Text Object",          COMPONENT_OBJECT,         OBJ_PRESENTATIONTEXT, SF_NAMED) \
+    X(EPT,  0xA99B, "EPT",   "End Presentation Text Object",            COMPONENT_OBJECT,         OBJ_PRESENTATIONTEXT, SF_NAMED) \
+    X(BPF,  0xA8A5, "BPF",   "Begin Print File",                        COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(EPF,  0xA9A5, "EPF",   "End Print File",                          COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(BDI,  0xA8A7, "BDI",   "Begin Document Index",                    COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(EDI,  0xA9A7, "EDI",   "End Document Index",                      COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(BDT,  0xA8A8, "BDT",   "Begin Document",                          COMPONENT_DOCUMENT,       OBJ_UNKNOWN,          SF_NAMED) \
+    X(EDT,  0xA9A8, "EDT",   "End Document",                            COMPONENT_DOCUMENT,       OBJ_UNKNOWN,          SF_NAMED) \
+    X(BNG,  0xA8AD, "BNG",   "Begin Named Page Group",                  COMPONENT_PAGE_GROUP,     OBJ_UNKNOWN,          SF_NAMED) \
+    X(ENG,  0xA9AD, "ENG",   "End Named Page Group",                    COMPONENT_PAGE_GROUP,     OBJ_UNKNOWN,          SF_NAMED) \
+    X(BPG,  0xA8AF, "BPG",   "Begin Page",                              COMPONENT_PAGE,           OBJ_UNKNOWN,          SF_NAMED) \
+    X(EPG,  0xA9AF, "EPG",   "End Page",                                COMPONENT_PAGE,           OBJ_UNKNOWN,          SF_NAMED) \
+    X(BGR,  0xA8BB, "BGR",   "Begin Graphics Object",                   COMPONENT_OBJECT,         OBJ_GRAPHICS,         SF_NAMED) \
+    X(EGR,  0xA9BB, "EGR",   "End Graphics Object",                     COMPONENT_OBJECT,         OBJ_GRAPHICS,         SF_NAMED) \
+    X(BDG,  0xA8C4, "BDG",   "Begin Document Environment Group",        COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(EDG,  0xA9C4, "EDG",   "End Document Environment Group",          COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(BFG,  0xA8C5, "BFG",   "Begin Form Environment Group",            COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(EFG,  0xA9C5, "EFG",   "End Form Environment Group",              COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(BRG,  0xA8C6, "BRG",   "Begin Resource Group",                    COMPONENT_RESOURCE_GROUP, OBJ_UNKNOWN,          SF_NAMED) \
+    X(ERG,  0xA9C6, "ERG",   "End Resource Group",                      COMPONENT_RESOURCE_GROUP, OBJ_UNKNOWN,          SF_NAMED) \
+    X(BOG,  0xA8C7, "BOG",   "Begin Object Environment Group",          COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(EOG,  0xA9C7, "EOG",   "End Object Environment Group",            COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(BAG,  0xA8C9, "BAG",   "Begin Active Environment Group",          COMPONENT_OBJECT,         OBJ_UNKNOWN,          SF_NAMED) \
+    X(EAG,  0xA9C9, "EAG",   "End Active Environment Group",            COMPONENT_OBJECT,         OBJ_UNKNOWN,          SF_NAMED) \
+    X(BMM,  0xA8CC, "BMM",   "Begin Medium Map",                        COMPONENT_RESOURCE,       OBJ_FORMDEF,          SF_NAMED) \
+    X(EMM,  0xA9CC, "EMM",   "End Medium Map",                          COMPONENT_RESOURCE,       OBJ_FORMDEF,          SF_NAMED) \
+    X(BFM,  0xA8CD, "BFM",   "Begin Form Map",                          COMPONENT_RESOURCE,       OBJ_FORMDEF,          SF_NAMED) \
+    X(EFM,  0xA9CD, "EFM",   "End Form Map",                            COMPONENT_RESOURCE,       OBJ_FORMDEF,          SF_NAMED) \
+    X(BRS,  0xA8CE, "BRS",   "Begin Resource",                          COMPONENT_RESOURCE,       OBJ_UNKNOWN,          SF_NAMED) \
+    X(ERS,  0xA9CE, "ERS",   "End Resource",                            COMPONENT_RESOURCE,       OBJ_UNKNOWN,          SF_NAMED) \
+    X(BSG,  0xA8D9, "BSG",   "Begin Resource Environment Group",        COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(ESG,  0xA9D9, "ESG",   "End Resource Environment Group",          COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(BMO,  0xA8DF, "BMO",   "Begin Overlay",                           COMPONENT_OVERLAY,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(EMO,  0xA9DF, "EMO",   "End Overlay",                             COMPONENT_OVERLAY,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(BBC,  0xA8EB, "BBC",   "Begin Bar Code Object",                   COMPONENT_OBJECT,         OBJ_BARCODE,          SF_NAMED) \
+    X(EBC,  0xA9EB, "EBC",   "End Bar Code Object",                     COMPONENT_OBJECT,         OBJ_BARCODE,          SF_NAMED) \
+    X(BIM,  0xA8FB, "BIM",   "Begin Image Object",                      COMPONENT_OBJECT,         OBJ_IMAGE,            SF_NAMED) \
+    X(EIM,  0xA9FB, "EIM",   "End Image Object",                        COMPONENT_OBJECT,         OBJ_IMAGE,            SF_NAMED) \
+    X(CPI,  0x8C87, "CPI",   "Code Page Index",                         COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(FNI,  0x8C89, "FNI",   "Font Index",                              COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(CFI,  0x8C8A, "CFI",   "Coded Font Index",                        COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(MFC,  0xA088, "MFC",   "Medium Finishing Control",                COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(TLE,  0xA090, "TLE",   "Tag Logical Element",                     COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(MCC,  0xA288, "MCC",   "Medium Copy Count",                       COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(FNM,  0xA289, "FNM",   "Font Patterns Map",                       COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(OBD,  0xA66B, "OBD",   "Object Area Descriptor",                  COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(IID,  0xA67B, "IID",   "Image Input Descriptor",                  COMPONENT_UNKNOWN,        OBJ_IMAGE,            0) \
+    X(CPD,  0xA687, "CPD",   "Code Page Descriptor",                    COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(MDD,  0xA688, "MDD",   "Medium Descriptor",                       COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(FND,  0xA689, "FND",   "Font Descriptor",                         COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(CDD,  0xA692, "CDD",   "Container Data Descriptor",               COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(PTD1, 0xA69B, "PTD-1", "Presentation Text Descriptor Format-1",   COMPONENT_UNKNOWN,        OBJ_PRESENTATIONTEXT, 0) \
+    X(PGD,  0xA6AF, "PGD",   "Page Descriptor",                         COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(GDD,  0xA6BB, "GDD",   "Graphics Data Descriptor",                COMPONENT_UNKNOWN,        OBJ_GRAPHICS,         0) \
+    X(FGD,  0xA6C5, "FGD",   "Form Environment Group Descriptor",       COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(BDD,  0xA6EB, "BDD",   "Bar Code Data Descriptor",                COMPONENT_UNKNOWN,        OBJ_BARCODE,          0) \
+    X(IDD,  0xA6FB, "IDD",   "Image Data Descriptor",                   COMPONENT_UNKNOWN,        OBJ_IMAGE,            0) \
+    X(IOC,  0xA77B, "IOC",   "IM Image Output Control",                 COMPONENT_UNKNOWN,        OBJ_IMAGE,            0) \
+    X(CPC,  0xA787, "CPC",   "Code Page Control",                       COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(MMC,  0xA788, "MMC",   "Medium Modification Control",             COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(FNC,  0xA789, "FNC",   "Font Control",                            COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(CFC,  0xA78A, "CFC",   "Coded Font Control",                      COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(CTC,  0xA79B, "CTC",   "Composed Text Control",                   COMPONENT_UNKNOWN,        OBJ_PRESENTATIONTEXT, 0) \
+    X(PEC,  0xA7A8, "PEC",   "Presentation Environment Control",        COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(PMC,  0xA7AF, "PMC",   "Page Modification Control",               COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(MCA,  0xAB77, "MCA",   "Map Color Attribute Table",               COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(MMT,  0xAB88, "MMT",   "Map Media Type",                          COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(FNN,  0xAB89, "FNN",   "Font Name Map",                           COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(MCF,  0xAB8A, "MCF",   "Map Coded Font",                          COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_REFERENCES) \
+    X(MCD,  0xAB92, "MCD",   "Map Container Data",                      COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(MPG,  0xABAF, "MPG",   "Map Page",                                COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(MGO,  0xABBB, "MGO",   "Map Graphics Object",                     COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(MDR,  0xABC3, "MDR",   "Map Data Resource",                       COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(IMM,  0xABCC, "IMM",   "Invoke Medium Map",                       COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(MPO,  0xABD8, "MPO",   "Map Page Overlay",                        COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_REFERENCES) \
+    X(MSU,  0xABEA, "MSU",   "Map Suppression",                         COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(MBC,  0xABEB, "MBC",   "Map Bar Code Object",                     COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(MIO,  0xABFB, "MIO",   "Map Image Object",                        COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(OBP,  0xAC6B, "OBP",   "Object Area Position",                    COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(ICP,  0xAC7B, "ICP",   "IM Image Cell Position",                  COMPONENT_UNKNOWN,        OBJ_IMAGE,            0) \
+    X(FNP,  0xAC89, "FNP",   "Font Position",                           COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(PGP1, 0xACAF, "PGP-1", "Page Position Format-1",                  COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(PPO,  0xADC3, "PPO",   "Preprocess Presentation Object",          COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(FNO,  0xAE89, "FNO",   "Font Orientation",                        COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(IPS,  0xAF5F, "IPS",   "Include Page Segment",                    COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(IPG,  0xAFAF, "IPG",   "Include Page",                            COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(IOB,  0xAFC3, "IOB",   "Include Object",                          COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(IPO,  0xAFD8, "IPO",   "Include Page Overlay",                    COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_NAMED) \
+    X(CAT,  0xB077, "CAT",   "Color Attribute Table",                   COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(MPS,  0xB15F, "MPS",   "Map Page Segment",                        COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          SF_REFERENCES) \
+    X(MCF1, 0xB18A, "MCF-1", "Map Coded Font Format-1",                 COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(PTD,  0xB19B, "PTD",   "Presentation Text Data Descriptor",       COMPONENT_UNKNOWN,        OBJ_PRESENTATIONTEXT, 0) \
+    X(PGP,  0xB1AF, "PGP",   "Page Position",                           COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(MMO,  0xB1DF, "MMO",   "Map Medium Overlay",                      COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(PFC,  0xB288, "PFC",   "Presentation Fidelity Control",           COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(IEL,  0xB2A7, "IEL",   "Index Element",                           COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(LLE,  0xB490, "LLE",   "Link Logical Element",                    COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(IRD,  0xEE7B, "IRD",   "IM Image Raster Data",                    COMPONENT_UNKNOWN,        OBJ_IMAGE,            0) \
+    X(FNG,  0xEE89, "FNG",   "Font Patterns",                           COMPONENT_UNKNOWN,        OBJ_FONT,             0) \
+    X(OCD,  0xEE92, "OCD",   "Object Container Data",                   COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(PTX,  0xEE9B, "PTX",   "Presentation Text Data",                  COMPONENT_UNKNOWN,        OBJ_PRESENTATIONTEXT, 0) \
+    X(GAD,  0xEEBB, "GAD",   "Graphics Data",                           COMPONENT_UNKNOWN,        OBJ_GRAPHICS,         0) \
+    X(BDA,  0xEEEB, "BDA",   "Bar Code Data",                           COMPONENT_UNKNOWN,        OBJ_BARCODE,          0) \
+    X(NOP,  0xEEEE, "NOP",   "No Operation",                            COMPONENT_UNKNOWN,        OBJ_UNKNOWN,          0) \
+    X(IPD,  0xEEFB, "IPD",   "Image Picture Data",                      COMPONENT_UNKNOWN,        OBJ_IMAGE,            0)
+
+typedef enum {
+    SF_UNKNOWN,
+#define SF_ENUM_ENTRY(id, code, acronym, name, component, obj_type, flags) SF_##id,
+    SF_TYPE_LIST(SF_ENUM_ENTRY)
+#undef SF_ENUM_ENTRY
+    SF_TYPE_COUNT
+} SFTypeId;
+
+typedef enum {
+    SF_KIND_OTHER,
+    SF_KIND_BEGIN, // D3A8xx
+    SF_KIND_END    // D3A9xx, closes the D3A8xx with the same last byte
+} SFKind;
+
+typedef struct {
+    uint16_t code; // Type bytes 1-2
+    const char *acronym;
+    const char *name;
+    AFPComponent component;
+    AFPObjectType obj_type;
+    SFKind kind;
+    unsigned char flags;
+} SFTypeInfo;
+
+#define SF_KIND_OF(code) \
+    ((code) >> 8 == 0xA8 ? SF_KIND_BEGIN : (code) >> 8 == 0xA9 ? SF_KIND_END : SF_KIND_OTHER)
+
+extern const SFTypeInfo sf_types[SF_TYPE_COUNT];
+extern const unsigned char sf_type_index[0x10000];
+
+// Look up a 3-byte structured field type
+static inline SFTypeId sf_type_id(const unsigned char *type) {
+    if (type[0] != 0xD3)
+        return SF_UNKNOWN;
+    return (SFTypeId)sf_type_index[(type[1] << 8) | type[2]];
+}
+
+// End field for a begin field and vice versa, SF_UNKNOWN for anything else
+static inline SFTypeId sf_pair(SFTypeId id) {
+    if (sf_types[id].kind == SF_KIND_OTHER)
+        return SF_UNKNOWN;
+    return (SFTypeId)sf_type_index[sf_types[id].code ^ 0x0100];
+}
+
+typedef struct {
+    uint16_t length;
+    unsigned char type[3];
+    unsigned char flags;
+    const unsigned char *data; // Points into the scanner, valid until the next field
+    SFTypeId id;
+    AFPComponent component;
+    AFPObjectType obj_type;
+    char name[9]; // Resource/Page name (null-terminated)
+} StructuredField;
+
+// EBCDIC code pages. Names and text go through a 256-byte table to
+// ISO 8859-1 and are written as UTF-8. A run uses the code page given in
+// its options, else the one named by the CGCSGID triplet of the first
+// Begin Document, else CODEPAGE_DEFAULT.
+#define CODEPAGE_COUNT 11
+#define CODEPAGE_DEFAULT 500 // International, the MO:DCA default
+#define EBCDIC_NAME_SIZE 17  // 8-byte name as UTF-8, NUL
+
+typedef struct {
+    uint16_t id;                 // CCSID, also the CPGID
+    const char *name;
+    const unsigned char *latin1; // EBCDIC byte to ISO 8859-1, controls as '.'
+} CodePage;
+
+extern const CodePage codepages[CODEPAGE_COUNT];
+const CodePage *codepage_find(unsigned id);
+bool ebcdic_convert(const unsigned char *table, const unsigned char *in, unsigned char *out, size_t length);
+size_t ebcdic_to_utf8(const CodePage *codepage, const unsigned char *data, size_t length, char *out);
+size_t latin1_to_utf8(unsigned char *p, size_t length);
+void ebcdic_name(const CodePage *codepage, const unsigned char *name, size_t length, char *text);
+
+// Containers opened by a Begin field (D3A8xx) and not yet closed by the
+// matching End field (D3A9xx), innermost last
+typedef struct {
+    uint16_t code;   // Type bytes 1-2 of the begin field
+    uint64_t offset; // Of the begin field
+    char name[9];    // EBCDIC, as in StructuredField
+} OpenContainer;
+
+typedef struct {
+    OpenContainer *items;
+    size_t count;
+    size_t capacity;
+} ContainerStack;
+
+#define SF_BEGIN_CODE(code) ((uint16_t)((code) ^ 0x0100)) // Begin code for an end code
+
+bool containers_push(ContainerStack *stack, uint16_t code, uint64_t offset, const char *name);
+void containers_free(ContainerStack *stack);
+bool container_restricted(SFTypeId id);
+bool container_allows(const ContainerStack *stack, SFTypeId id);
+void container_label(const OpenContainer *container, const CodePage *codepage, char *label, size_t size);
+void field_type_label(uint16_t code, char *label, size_t size);
+
+// Input scanner. Regular files are memory-mapped so structured fields are
+// read in place; anything that cannot be mapped (pipes, devices, stdin) goes
+// through a fixed sliding window refilled with large reads, so memory use
+// does not depend on input size and the input is never seeked. Pointers
+// returned by scanner_peek stay valid until the next scanner call.
+#define SCANNER_WINDOW_SIZE (1 << 20) // Must hold the largest field (65536 bytes)
+
+// Seek and tell with 64-bit offsets where long has 32 bits (Windows, 32-bit
+// builds with _FILE_OFFSET_BITS=64)
+#ifdef _WIN32
+#define afp_fseek _fseeki64
+#define afp_ftell _ftelli64
+#else
+#define afp_fseek fseeko
+#define afp_ftell ftello
+#endif
+
+typedef struct {
+    const unsigned char *map; // Mapped file or caller buffer, NULL in buffered mode
+    bool mapped;              // map was created by scanner_open
+    FILE *file;               // Buffered fallback
+    unsigned char *window;
+    size_t window_start;      // Offset of the current position inside window
+    size_t window_len;        // Valid bytes in window
+    uint64_t position;        // Absolute offset of the current position
+    uint64_t size;            // Unknown (0) when streaming
+    bool streaming;           // Size unknown, read until end of input
+    bool sparse;              // Buffered file: read only what is peeked, seek over skips
+    bool error;
+} AFPScanner;
+
+bool scanner_open(AFPScanner *scanner, const char *filename);
+void scanner_open_buffer(AFPScanner *scanner, const unsigned char *data, size_t size);
+void scanner_close(AFPScanner *scanner);
+const unsigned char *scanner_peek(AFPScanner *scanner, size_t want, size_t *avail);
+void scanner_skip(AFPScanner *scanner, size_t count);
+bool scanner_seek(AFPScanner *scanner, uint64_t offset);
+bool scanner_find(AFPScanner *scanner, unsigned char byte);
+void scanner_sparse(AFPScanner *scanner);
+
+// Resynchronization after corrupt data: candidate introducers are located
+// with memchr and only accepted when they start a chain of plausible
+// headers (0x5A, length of at least 8, MO:DCA type class 0xD3). A chain may
+// also end exactly at the end of input.
+#define RESYNC_CHAIN_LENGTH 4
+
+bool scanner_chain_plausible(AFPScanner *scanner, int count);
+bool scanner_resync(AFPScanner *scanner);
+
+// Field types and names
+void identify_field_type(StructuredField *field);
+const char *get_component_name(AFPComponent component);
+const char *get_object_type_name(AFPObjectType type);
+
+// Field size histogram: bucket b counts the fields of 2^(b+3) to 2^(b+4)-1
+// bytes, from the 9-byte minimum up to the 65536-byte maximum
+#define LENGTH_BUCKETS 14
+#define LARGEST_PAGES 5
+
+// Fields of one type, indexed by SFTypeId
+typedef struct {
+    uint64_t count;
+    uint64_t bytes;     // Whole fields, introducer included
+    uint64_t lengths[LENGTH_BUCKETS];
+    uint64_t largest;   // Size of the largest field
+    uint64_t largest_offset;
+} FieldTypeStatistics;
+
+// Begin Page ... End Page span
+typedef struct {
+    uint64_t number; // 1-based
+    uint64_t offset;
+    uint64_t size;
+} PageSize;
+
+typedef struct {
+    uint64_t documents;
+    uint64_t page_groups;
+    uint64_t pages;
+    uint64_t overlays;
+    uint64_t resource_groups;
+    uint64_t presentation_text;
+    uint64_t images;
+    uint64_t graphics;
+    uint64_t barcodes;
+    uint64_t fonts;
+    uint64_t form_defs;
+    uint64_t page_segments;
+    FieldTypeStatistics types[SF_TYPE_COUNT];
+    PageSize largest_pages[LARGEST_PAGES]; // Largest first
+    size_t largest_page_count;
+    uint64_t page_start; // Offset of the open Begin Page
+    bool page_open;
+} AFPStatistics;
+
+void update_statistics(AFPStatistics *stats, const StructuredField *field, uint64_t position, size_t field_size);
+void statistics_add(AFPStatistics *total, const AFPStatistics *part);
+void statistics_add_page(AFPStatistics *stats, const PageSize *page);
+int length_bucket(size_t field_size);
+
+// Report writer: a fixed buffer flushed to file in large blocks. A writer
+// without a file discards everything.
+#define WRITER_BUFFER_SIZE (1 << 16)
+
+typedef struct {
+    FILE *file;
+    size_t length; // Bytes waiting in buffer
+    bool error;
+    char buffer[WRITER_BUFFER_SIZE];
+} AFPWriter;
+
+void writer_init(AFPWriter *writer, FILE *file);
+void writer_flush(AFPWriter *writer);
+void writer_write(AFPWriter *writer, const void *data, size_t length);
+void writer_puts(AFPWriter *writer, const char *text);
+void writer_printf(AFPWriter *writer, const char *format, ...);
+void writer_hex(AFPWriter *writer, const unsigned char *data, size_t length);
+void writer_ebcdic(AFPWriter *writer, const CodePage *codepage, const unsigned char *data, size_t length);
+void writer_uint(AFPWriter *writer, uint64_t value);
+void writer_quoted(AFPWriter *writer, const char *text, size_t length);
+
+// JSON objects written one per line, for the JSON report formats
+#define JSON_MAX_DEPTH 8
+
+typedef struct {
+    AFPWriter *out;
+    int depth;
+    bool first[JSON_MAX_DEPTH]; // Nothing written yet at this level
+} JSONWriter;
+
+void json_begin(JSONWriter *json, AFPWriter *out);
+void json_end(JSONWriter *json);
+void json_object(JSONWriter *json, const char *key);
+void json_array(JSONWriter *json, const char *key);
+void json_close(JSONWriter *json, char bracket);
+void json_string(JSONWriter *json, const char *key, const char *value);
+void json_uint(JSONWriter *json, const char *key, uint64_t value);
+void json_bool(JSONWriter *json, const char *key, bool value);
+
+// XXH64 content hash, fed in pieces
+typedef struct {
+    uint64_t lanes[4];
+    uint64_t total;
+    unsigned char buffer[32]; // Tail shorter than a stripe
+    size_t buffered;
+} XXH64State;
+
+void xxh64_init(XXH64State *state, uint64_t seed);
+void xxh64_update(XXH64State *state, const void *data, size_t length);
+uint64_t xxh64_digest(const XXH64State *state);
+
+// Growable arrays and little-endian fields of binary files
+bool array_reserve(void **items, size_t *capacity, size_t needed, size_t item_size);
+void put_le(unsigned char *p, uint64_t value, int bytes);
+uint64_t get_le(const unsigned char *p, int bytes);
+void put_u64(FILE *file, uint64_t value);
+bool get_u64(FILE *file, uint64_t *value);
+
+// Offset index built during a scan: one packed record per structured field
+// and the byte ranges of every page and document. It is saved as a sidecar
+// file next to the AFP file and reused while the file is unchanged.
+#define INDEX_RECORD_SIZE 18 // offset(8) page(4) length(2) type(3) flags(1), little-endian
+
+typedef struct {
+    uint64_t start; // Offset of the Begin field
+    uint64_t end;   // Offset just past the End field, 0 if never closed
+} IndexRange;
+
+typedef struct {
+    unsigned char *records;
+    size_t record_count;
+    size_t record_capacity;
+    IndexRange *pages;
+    size_t page_count;
+    size_t page_capacity;
+    IndexRange *documents;
+    size_t document_count;
+    size_t document_capacity;
+    uint32_t current_page;        // 1-based page of the next field, 0 outside pages
+    uint64_t orphan_page_end;     // Chunks: end of a page begun in an earlier chunk
+    uint64_t orphan_document_end;
+    bool failed;                  // Out of memory, the index is incomplete
+} AFPIndex;
+
+void index_free(AFPIndex *index);
+void index_add_field(AFPIndex *index, uint64_t position, const StructuredField *field, size_t field_size);
+void index_append(AFPIndex *dst, const AFPIndex *src);
+
+// What a sidecar file was built from. The sample hash covers the first and
+// last 64 KiB, so a file rewritten with the same size and time is still noticed.
+typedef struct {
+    uint64_t size;
+    int64_t mtime;
+    uint64_t sample_hash;
+} FileIdentity;
+
+// Restart checkpoints of a serial run: the state at a field boundary is
+// saved every interval bytes in <afp_file>.afpckpt, so a killed run can
+// resume there instead of at the start
+typedef struct {
+    char *path;
+    FileIdentity identity;
+    uint64_t interval;
+    uint64_t next;   // Position after which the next checkpoint is written
+    bool failed;     // A checkpoint could not be written; no more are tried
+} Checkpoint;
+
+// Field found while a chunk had nothing open: an end field whose begin lies
+// before the chunk, or a field whose container does. Checked at the merge.
+typedef struct {
+    uint16_t code; // Type bytes 1-2
+    uint64_t position;
+} PendingField;
+
+// Triplets: length(1), id(1), data. The iterator walks them in place and
+// checks every length against the field bounds.
+#define TRIPLETS_NONE (-1)
+#define TRIPLETS_GROUPED (-2)
+
+typedef struct {
+    unsigned char id;
+    unsigned char length;        // Including the length and id bytes
+    const unsigned char *data;   // After the id
+    size_t data_length;
+} Triplet;
+
+typedef struct {
+    const unsigned char *next;
+    const unsigned char *end;
+    const unsigned char *group_end; // End of the current repeating group
+    const unsigned char *offset;    // Last triplet returned, or the malformed one
+    bool grouped;
+    bool malformed;                 // A length ran past the data
+} TripletIterator;
+
+const char *get_triplet_name(unsigned char id);
+void triplets_init(TripletIterator *it, const unsigned char *data, size_t length, bool grouped);
+bool triplets_of_field(TripletIterator *it, const StructuredField *field);
+bool triplet_next(TripletIterator *it, Triplet *triplet);
+bool triplet_check(const Triplet *triplet, char *message, size_t size);
+const CodePage *codepage_of_triplet(const Triplet *triplet);
+const CodePage *codepage_of_field(const StructuredField *field);
+
+// Resource references: definitions and references keyed on name and class
+typedef enum {
+    RESOURCE_ANY,          // BRS without a Resource Object Type triplet
+    RESOURCE_OVERLAY,
+    RESOURCE_PAGE_SEGMENT,
+    RESOURCE_FONT,         // Coded fonts, font character sets and code pages
+    RESOURCE_OBJECT,       // Data objects included with IOB
+    RESOURCE_CLASS_COUNT
+} ResourceClass;
+
+typedef struct {
+    unsigned char name[8];    // EBCDIC
+    unsigned char resource_class;
+    bool used;                // Slot taken
+    bool defined;
+    uint32_t references;
+    uint64_t definition;      // Offset of the defining field
+    uint64_t first_reference; // Offset of the first referencing field
+} ResourceEntry;
+
+typedef struct {
+    ResourceEntry *entries;
+    size_t capacity; // Power of two, 0 while empty
+    size_t count;
+    bool failed;     // Out of memory, some names are missing
+} ResourceTable;
+
+const char *get_resource_class_name(ResourceClass resource_class);
+void resources_define(ResourceTable *table, const unsigned char *name, ResourceClass resource_class,
+                      uint64_t position);
+void resources_reference(ResourceTable *table, const unsigned char *name, ResourceClass resource_class,
+                         uint64_t position);
+void resources_collect(ResourceTable *table, const StructuredField *field, uint64_t position);
+const ResourceEntry *resources_find(const ResourceTable *table, const unsigned char *name,
+                                    ResourceClass resource_class);
+bool resource_resolved(const ResourceTable *table, const ResourceEntry *entry);
+bool resource_used(const ResourceTable *table, const ResourceEntry *entry);
+void resources_merge(ResourceTable *dst, const ResourceTable *src);
+bool resources_restore(ResourceTable *table, const ResourceEntry *saved);
+void resources_free(ResourceTable *table);
+void resource_name(const ResourceEntry *entry, const CodePage *codepage, char name[EBCDIC_NAME_SIZE]);
+bool resource_definition(const StructuredField *field, ResourceClass *resource_class);
+
+// Content hash of one inline resource: every byte from its begin field
+// (BRS, BMO or BPS) through the matching end field
+typedef struct {
+    uint64_t hash;     // XXH64
+    uint64_t size;
+    uint64_t offset;   // Of the begin field
+    unsigned char name[8];
+    unsigned char resource_class;
+} ResourceFingerprint;
+
+typedef struct {
+    ResourceFingerprint *items;
+    size_t count;
+    size_t capacity;
+} FingerprintList;
+
+// Outermost resource being hashed
+typedef struct {
+    bool open;
+    SFTypeId end;      // Field that closes it
+    XXH64State hash;
+    ResourceFingerprint print;
+} FingerprintSpan;
+
+void fingerprint_field(FingerprintSpan *span, FingerprintList *list, const StructuredField *field,
+                       const unsigned char *bytes, size_t size, uint64_t position);
+bool fingerprints_append(FingerprintList *dst, const FingerprintList *src);
+void fingerprints_free(FingerprintList *list);
+void fingerprint_name(const ResourceFingerprint *print, const CodePage *codepage, char name[EBCDIC_NAME_SIZE]);
+
+// Byte-identical resources found in a batch
+typedef struct {
+    ResourceFingerprint print; // First copy
+    size_t file;               // Input holding the first copy
+    size_t copies;
+    size_t files;              // Inputs holding a copy
+    uint64_t saved;            // Bytes saved by keeping one copy in a resource library
+} DuplicateGroup;
+
+typedef struct {
+    size_t resources;  // Inline resources hashed
+    uint64_t bytes;
+    size_t distinct;
+    size_t copies;     // Resources with an identical twin
+    uint64_t saved;
+    DuplicateGroup *groups; // Largest savings first
+    size_t group_count;
+} DuplicateReport;
+
+bool duplicates_find(const FingerprintList *lists, size_t list_count, DuplicateReport *report);
+void duplicates_free(DuplicateReport *report);
+
+// Resolution results, each list in file order
+typedef struct {
+    size_t defined;
+    size_t referenced;
+    uint64_t references;
+    const ResourceEntry **unresolved; // Referenced, never defined
+    size_t unresolved_count;
+    const ResourceEntry **unused;     // Defined, never referenced
+    size_t unused_count;
+} ResourceSummary;
+
+bool resources_summarize(const ResourceTable *table, ResourceSummary *summary);
+void resource_summary_free(ResourceSummary *summary);
+
+// Presentation text extraction: the characters of the Presentation Text
+// Data fields of each page, a line per baseline, a form feed per page. The
+// text is staged in EBCDIC and converted a block at a time; the positions
+// of the line and page breaks staged with it are kept apart, so control
+// characters in the text itself never pass for breaks.
+#define TEXT_STAGE_SIZE 8192
+#define TEXT_BREAKS 1024
+
+typedef struct {
+    AFPWriter *out;   // NULL when no text is extracted
+    const CodePage *codepage; // Of the staged text
+    size_t staged;
+    unsigned char stage[TEXT_STAGE_SIZE];
+    uint16_t breaks[TEXT_BREAKS]; // Stage positions of breaks
+    size_t break_count;
+    unsigned char utf8[2 * TEXT_STAGE_SIZE];
+    bool in_page;
+    bool line_open;   // Characters written since the last line break
+    bool gap;         // Moved inline since the last characters
+    int32_t baseline; // Current baseline position
+} TextExtractor;
+
+void text_field(TextExtractor *text, const CodePage *codepage, const StructuredField *field);
+void text_flush(TextExtractor *text);
+
+// Performance counters for --stats-perf. They are compiled in only with
+// AFP_PERF (make PERF=1); otherwise the PERF_ macros expand to nothing. The
+// counters belong to the thread that runs the scan, so a pass reports the
+// difference over its run and parallel chunks hand theirs to the merge.
+typedef enum {
+    PERF_READ,     // Getting field bytes from the input, resynchronizing
+    PERF_DECODE,   // Header and type decoding
+    PERF_VALIDATE, // Nesting, placement, resources, triplets, statistics
+    PERF_PRINT,    // Verbose dumps, events and the summary
+    PERF_PHASE_COUNT
+} PerfPhase;
+
+typedef struct {
+    uint64_t bytes_read;   // Through buffered reads
+    uint64_t bytes_mapped;
+    uint64_t io_calls;     // open, stat, read, seek and map calls
+    uint64_t allocations;  // Table and buffer allocations and growth
+    uint64_t phase_ns[PERF_PHASE_COUNT];
+} PerfCounters;
+
+#ifdef AFP_PERF
+#ifdef _MSC_VER
+#define AFP_THREAD_LOCAL __declspec(thread)
+#else
+#define AFP_THREAD_LOCAL __thread
+#endif
+extern AFP_THREAD_LOCAL PerfCounters perf;
+uint64_t perf_clock(void);
+void perf_lap(uint64_t *mark, PerfPhase phase);
+#define PERF_COUNT(counter, n) (perf.counter += (uint64_t)(n))
+#define PERF_MARK(state) do { if ((state)->perf) (state)->perf_mark = perf_clock(); } while (0)
+#define PERF_LAP(state, phase) do { if ((state)->perf) perf_lap(&(state)->perf_mark, phase); } while (0)
+#else
+#define PERF_COUNT(counter, n) ((void)0)
+#define PERF_MARK(state) ((void)0)
+#define PERF_LAP(state, phase) ((void)0)
+#endif
+
+void perf_snapshot(PerfCounters *counters);
+void perf_since(PerfCounters *total, const PerfCounters *start);
+void perf_add(PerfCounters *total, const PerfCounters *more);
+
+// Running state of one validation pass. A pass covers either the whole
+// input or one chunk of it; chunk passes are merged in file order.
+typedef struct {
+    AFPWriter *out;    // Text report, discarded in the JSON formats
+    AFPWriter *json;   // JSON report, NULL in text format
+    bool json_events;  // JSON Lines: an event per error and resync
+    bool json_fields;  // JSON Lines: an event per field as well
+    const char *source; // Input name in JSON reports
+    bool verbose;
+    size_t dump_limit; // Data bytes dumped per field in verbose mode, 0 for all
+    uint64_t file_size;
+    bool is_valid;
+    bool stopped; // Gave up after too many errors
+    int max_errors;
+    uint64_t field_count;
+    uint64_t error_count;
+    uint64_t skipped_bytes; // Corrupt bytes passed over while resynchronizing
+    bool has_begin_document;
+    bool has_end_document;
+    ContainerStack containers;
+    uint64_t page_count;
+    uint64_t object_count;
+    uint64_t resource_count;
+    AFPStatistics stats;
+    ResourceTable resources;
+    bool fingerprint;          // Hash inline resources
+    bool deep;                 // Check triplets
+    bool structure_only;       // Skip the payloads nothing reads
+    const CodePage *codepage;  // Names and text are shown in this code page
+    bool codepage_fixed;       // Given in the options
+    bool document_seen;        // The first Begin Document was passed
+    const CodePage *document_codepage; // Named by the first Begin Document
+    FingerprintSpan span;
+    FingerprintList fingerprints;
+    TextExtractor text;        // Page text, written when text.out is set (serial passes only)
+    AFPIndex *index; // Collects field offsets when not NULL
+    Checkpoint *checkpoint; // Writes restart checkpoints when not NULL
+    bool partial;    // Only a page range was validated
+    bool growing;    // Follow mode: the file may grow, so an incomplete last field is waited for
+    const AFPVisitor *visitor; // NULL when nobody is listening
+    void *user;
+    bool perf;                  // --stats-perf
+    uint64_t perf_mark;         // End of the last timed phase
+    int perf_threads;           // Threads whose counters were added
+    PerfCounters perf_start;    // Thread counters when the pass started
+    PerfCounters perf_counters; // Totals of finished passes (chunks)
+
+    // Chunk passes only
+    bool is_chunk;
+    bool overran; // A field crossed the end of the chunk
+    PendingField *pending;
+    size_t pending_count;
+    size_t pending_capacity;
+} ValidationState;
+
+void state_init(ValidationState *state, AFPWriter *out, const ValidationOptions *options, uint64_t file_size);
+void state_free(ValidationState *state);
+void state_close(ValidationState *state, uint16_t code, uint64_t position);
+void state_place(ValidationState *state, uint16_t code, uint64_t position);
+void state_document_codepage(ValidationState *state, const CodePage *codepage);
+void scan_fields(ValidationState *state, AFPScanner *scanner);
+const CodePage *document_codepage(AFPScanner *scanner, uint64_t limit);
+bool validate_parallel(ValidationState *state, const AFPScanner *scanner, int threads);
+bool validate_file_fingerprints(const char *filename, const ValidationOptions *options, FILE *out,
+                                ValidationResult *result, FingerprintList *fingerprints);
+
+// Text report
+void print_ebcdic_string(AFPWriter *out, const CodePage *codepage, const unsigned char *data, size_t length);
+void print_hex(AFPWriter *out, const unsigned char *data, size_t length);
+void print_ebcdic_type(AFPWriter *out, const unsigned char *type);
+void print_structure_summary(AFPWriter *out, const ContainerStack *stack, const CodePage *codepage, uint64_t page_count,
+                             uint64_t object_count,
+                             uint64_t resource_count);
+void print_statistics(AFPWriter *out, AFPStatistics *stats);
+void print_resource_references(AFPWriter *out, const ResourceTable *table, const CodePage *codepage);
+void print_fingerprints(AFPWriter *out, const FingerprintList *list, const CodePage *codepage);
+void print_triplets(AFPWriter *out, TripletIterator *it, const CodePage *codepage);
+void print_validation_summary(ValidationState *state);
+void print_perf_summary(ValidationState *state);
+void report_json_error(ValidationState *state, uint64_t position, const char *message);
+void report_json_resync(ValidationState *state, uint64_t start, uint64_t skipped, bool found);
+void report_json_field(ValidationState *state, const StructuredField *field, uint64_t position);
+void report_json_summary(ValidationState *state);
+void report_json_failure(AFPWriter *out, const char *source, const char *message);
+
+// Sidecar files: the index and checkpoints, written atomically
+bool file_identity(const char *filename, FileIdentity *identity);
+char *sidecar_path(const char *filename, const char *extension);
+FILE *sidecar_create(const char *path, char **temp);
+bool sidecar_commit(FILE *file, const char *path, char *temp);
+uint64_t state_settings(const ValidationState *state);
+void state_write_summary(FILE *file, ValidationState *state);
+bool state_read_summary(FILE *file, ValidationState *state);
+char *index_path(const char *filename);
+bool index_write(const char *path, const FileIdentity *identity, ValidationState *state, const AFPIndex *index);
+bool index_read(const char *path, const FileIdentity *identity, ValidationState *state, AFPIndex *index);
+bool load_page_table(const char *filename, AFPScanner *scanner, bool use_index, AFPIndex *index,
+                     bool *from_index);
+bool page_range(const AFPIndex *index, uint64_t file_size, uint32_t first, uint32_t last,
+                uint64_t *start, uint64_t *end);
+bool checkpoint_write(Checkpoint *checkpoint, ValidationState *state, uint64_t position);
+bool checkpoint_read(const Checkpoint *checkpoint, ValidationState *state, uint64_t *position);
+
+#endif // AFP_INTERNAL_H
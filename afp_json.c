@@ -0,0 +1,96 @@
+// JSON serializer for the machine-readable reports. Values are written
+// straight into an AFPWriter without going through printf.
+#include "afp_internal.h"
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static void json_separator(JSONWriter *json, const char *key) {
+    if (!json->first[json->depth])
+        writer_write(json->out, ",", 1);
+    json->first[json->depth] = false;
+    if (key) {
+        writer_quoted(json->out, key, strlen(key));
+        writer_write(json->out, ":", 1);
+    }
+}
+
+static void json_open(JSONWriter *json, const char *key, char bracket) {
+    json_separator(json, key);
+    writer_write(json->out, &bracket, 1);
+    if (json->depth + 1 < JSON_MAX_DEPTH)
+        json->depth++;
+    json->first[json->depth] = true;
+}
+
+// Quoted JSON string with the mandatory escapes
+void writer_quoted(AFPWriter *writer, const char *text, size_t length) {
+    size_t run = 0; // Bytes that need no escaping, written in one piece
+
+    writer_write(writer, "\"", 1);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        writer_write(writer, text + run, i - run);
+        run = i + 1;
+        if (c == '"' || c == '\\') {
+            char escape[2] = {'\\', (char)c};
+            writer_write(writer, escape, 2);
+        } else if (c == '\n') {
+            writer_write(writer, "\\n", 2);
+        } else {
+            char escape[6] = {'\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 0x0F]};
+            writer_write(writer, escape, 6);
+        }
+    }
+    writer_write(writer, text + run, length - run);
+    writer_write(writer, "\"", 1);
+}
+
+// Start a top-level object
+void json_begin(JSONWriter *json, AFPWriter *out) {
+    json->out = out;
+    json->depth = 0;
+    json->first[0] = true;
+    writer_write(out, "{", 1);
+}
+
+// Close the top-level object and end the line
+void json_end(JSONWriter *json) {
+    writer_write(json->out, "}\n", 2);
+}
+
+void json_object(JSONWriter *json, const char *key) {
+    json_open(json, key, '{');
+}
+
+void json_array(JSONWriter *json, const char *key) {
+    json_open(json, key, '[');
+}
+
+// Close the innermost object ('}') or array (']')
+void json_close(JSONWriter *json, char bracket) {
+    writer_write(json->out, &bracket, 1);
+    if (json->depth > 0)
+        json->depth--;
+}
+
+// Values; key is NULL for array elements
+void json_string(JSONWriter *json, const char *key, const char *value) {
+    json_separator(json, key);
+    writer_quoted(json->out, value, strlen(value));
+}
+
+void json_uint(JSONWriter *json, const char *key, uint64_t value) {
+    json_separator(json, key);
+    writer_uint(json->out, value);
+}
+
+void json_bool(JSONWriter *json, const char *key, bool value) {
+    json_separator(json, key);
+    if (value)
+        writer_write(json->out, "true", 4);
+    else
+        writer_write(json->out, "false", 5);
+}
@@ -0,0 +1,221 @@
+// Intra-file parallel validation
+#include "afp_internal.h"
+
+#include <pthread.h>
+
+// Intra-file parallelism: a mapped file is cut at Begin Page fields into one
+// chunk per thread. Each chunk is validated with its own stack and counters;
+// fields met while the chunk has nothing open (end fields closing something
+// opened earlier, fields whose container lies earlier) are kept aside and
+// checked when the chunks are merged in file order.
+#define PARALLEL_MIN_CHUNK (4 << 20) // Smaller pieces are not worth a thread
+
+// First verified Begin Page field at or after offset, or 0 when there is none
+static uint64_t find_page_boundary(const AFPScanner *scanner, uint64_t offset) {
+    AFPScanner view = *scanner; // Shares the mapping
+    view.position = offset;
+
+    while (scanner_find(&view, SF_INTRODUCER)) {
+        size_t avail;
+        const unsigned char *p = scanner_peek(&view, 6, &avail);
+        if (avail == 6 && p[3] == 0xD3 && p[4] == 0xA8 && p[5] == 0xAF &&
+            scanner_chain_plausible(&view, RESYNC_CHAIN_LENGTH))
+            return view.position;
+        scanner_skip(&view, 1);
+    }
+    return 0;
+}
+
+// Fold a chunk into the state of everything before it
+static void state_merge(ValidationState *state, ValidationState *chunk) {
+    for (size_t i = 0; i < chunk->pending_count; i++) {
+        PendingField *pending = &chunk->pending[i];
+        if (pending->code >> 8 == 0xA9)
+            state_close(state, pending->code, pending->position);
+        else
+            state_place(state, pending->code, pending->position);
+    }
+    for (size_t i = 0; i < chunk->containers.count; i++) {
+        const OpenContainer *open = &chunk->containers.items[i];
+        if (!containers_push(&state->containers, open->code, open->offset, open->name)) {
+            writer_puts(state->out, "Error: Memory allocation failed\n");
+            state->is_valid = false;
+            break;
+        }
+    }
+
+    state->is_valid = state->is_valid && chunk->is_valid;
+    state->stopped = chunk->stopped;
+    state->field_count += chunk->field_count;
+    state->error_count += chunk->error_count;
+    state->skipped_bytes += chunk->skipped_bytes;
+    state->has_begin_document = state->has_begin_document || chunk->has_begin_document;
+    if (!state->document_seen && chunk->document_seen)
+        state_document_codepage(state, chunk->document_codepage);
+    state->has_end_document = state->has_end_document || chunk->has_end_document;
+    state->page_count += chunk->page_count;
+    state->object_count += chunk->object_count;
+    state->resource_count += chunk->resource_count;
+    statistics_add(&state->stats, &chunk->stats);
+    perf_add(&state->perf_counters, &chunk->perf_counters);
+    state->perf_threads += chunk->perf_threads;
+    resources_merge(&state->resources, &chunk->resources);
+    if (state->fingerprint && !fingerprints_append(&state->fingerprints, &chunk->fingerprints)) {
+        writer_puts(state->out, "Warning: Not enough memory to keep every resource fingerprint\n");
+    }
+    if (state->index) {
+        index_append(state->index, chunk->index);
+    }
+}
+
+static void copy_report(FILE *from, AFPWriter *to) {
+    char buffer[65536];
+    size_t got;
+
+    rewind(from);
+    while ((got = fread(buffer, 1, sizeof(buffer), from)) > 0) {
+        writer_write(to, buffer, got);
+    }
+}
+
+typedef struct {
+    AFPScanner view; // Shares the mapping of the file scanner
+    ValidationState state;
+    AFPWriter report; // Buffers the chunk's report in a temporary file
+    AFPWriter text;   // Discarded text report of a chunk in JSON format
+} ChunkJob;
+
+static void *chunk_worker(void *arg) {
+    ChunkJob *chunk = arg;
+    if (chunk->state.perf)
+        perf_snapshot(&chunk->state.perf_start);
+    scan_fields(&chunk->state, &chunk->view);
+    if (chunk->state.perf)
+        perf_since(&chunk->state.perf_counters, &chunk->state.perf_start);
+    // A resource running into the next chunk is hashed by a serial scan
+    if (chunk->state.span.open && chunk->view.size < chunk->state.file_size)
+        chunk->state.overran = true;
+    writer_flush(&chunk->report);
+    writer_flush(&chunk->text);
+    return NULL;
+}
+
+// Validate a mapped file in parallel chunks. Returns false, with state
+// untouched, when the file cannot be split and must be scanned serially.
+bool validate_parallel(ValidationState *state, const AFPScanner *scanner, int threads) {
+    uint64_t size = scanner->size;
+    if (!scanner->map || threads < 2 || size < 2 * (uint64_t)PARALLEL_MIN_CHUNK)
+        return false;
+
+    if ((uint64_t)threads > size / PARALLEL_MIN_CHUNK)
+        threads = (int)(size / PARALLEL_MIN_CHUNK);
+
+    uint64_t *starts = malloc(((size_t)threads + 1) * sizeof(uint64_t));
+    if (!starts)
+        return false;
+
+    // Boundary pass: one split point per thread, each on a verified Begin Page
+    int chunk_count = 1;
+    starts[0] = 0;
+    for (int k = 1; k < threads; k++) {
+        uint64_t target = size / (uint64_t)threads * (uint64_t)k;
+        if (target < starts[chunk_count - 1] + PARALLEL_MIN_CHUNK)
+            continue;
+        uint64_t boundary = find_page_boundary(scanner, target);
+        if (boundary == 0)
+            break;
+        if (boundary > starts[chunk_count - 1])
+            starts[chunk_count++] = boundary;
+    }
+    starts[chunk_count] = size;
+
+    if (chunk_count < 2) {
+        free(starts);
+        return false;
+    }
+
+    // Chunks after the first show names in the code page of the document
+    // they are part of, as a serial scan would by the time it got there
+    int codepage = state->codepage_fixed ? state->codepage->id : 0;
+    int later_codepage = codepage;
+    if (!state->codepage_fixed) {
+        AFPScanner view = *scanner; // Shares the mapping
+        const CodePage *document = document_codepage(&view, starts[1]);
+        later_codepage = document ? document->id : CODEPAGE_DEFAULT;
+    }
+
+    ChunkJob *chunks = calloc((size_t)chunk_count, sizeof(ChunkJob));
+    pthread_t *tids = malloc((size_t)chunk_count * sizeof(pthread_t));
+    bool ok = chunks && tids;
+    int created = 0;
+
+    for (int i = 0; ok && i < chunk_count; i++) {
+        FILE *report = tmpfile();
+        if (!report) {
+            ok = false;
+            break;
+        }
+        ValidationOptions chunk_options = {.threads = 1, .format = AFP_REPORT_TEXT,
+                                           .fingerprint = state->fingerprint, .deep = state->deep,
+                                           .structure_only = state->structure_only, .stats_perf = state->perf,
+                                           .codepage = i > 0 ? later_codepage : codepage};
+        writer_init(&chunks[i].report, report);
+        writer_init(&chunks[i].text, NULL);
+        if (state->json) {
+            // The chunk report holds JSON events, the text goes nowhere
+            state_init(&chunks[i].state, &chunks[i].text, &chunk_options, state->file_size);
+            chunks[i].state.json = &chunks[i].report;
+            chunks[i].state.json_events = state->json_events;
+            chunks[i].state.source = state->source;
+        } else {
+            state_init(&chunks[i].state, &chunks[i].report, &chunk_options, state->file_size);
+        }
+        if (state->index && !(chunks[i].state.index = calloc(1, sizeof(AFPIndex)))) {
+            fclose(report);
+            ok = false;
+            break;
+        }
+        chunks[i].state.is_chunk = i > 0;
+        chunks[i].view = *scanner;
+        chunks[i].view.position = starts[i];
+        chunks[i].view.size = starts[i + 1];
+        created++;
+    }
+
+    int started = 0;
+    for (int i = 0; ok && i < chunk_count; i++) {
+        if (pthread_create(&tids[i], NULL, chunk_worker, &chunks[i]) != 0) {
+            ok = false;
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    for (int i = 0; ok && i < chunk_count; i++) {
+        if (chunks[i].state.overran)
+            ok = false;
+    }
+
+    if (ok) {
+        for (int i = 0; i < chunk_count && !state->stopped; i++) {
+            copy_report(chunks[i].report.file, state->json ? state->json : state->out);
+            state_merge(state, &chunks[i].state);
+        }
+    }
+
+    for (int i = 0; i < created; i++) {
+        fclose(chunks[i].report.file);
+        if (chunks[i].state.index) {
+            index_free(chunks[i].state.index);
+            free(chunks[i].state.index);
+        }
+        state_free(&chunks[i].state);
+    }
+    free(chunks);
+    free(tids);
+    free(starts);
+    return ok;
+}
@@ -0,0 +1,51 @@
+// Performance counters for --stats-perf, compiled in with AFP_PERF
+#include "afp_internal.h"
+
+#ifdef AFP_PERF
+#include <time.h>
+
+AFP_THREAD_LOCAL PerfCounters perf;
+
+uint64_t perf_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Charge the time since *mark to phase and start the next phase
+void perf_lap(uint64_t *mark, PerfPhase phase) {
+    uint64_t now = perf_clock();
+    perf.phase_ns[phase] += now - *mark;
+    *mark = now;
+}
+#endif
+
+// Counters of the calling thread; all zero without AFP_PERF
+void perf_snapshot(PerfCounters *counters) {
+#ifdef AFP_PERF
+    *counters = perf;
+#else
+    memset(counters, 0, sizeof(*counters));
+#endif
+}
+
+// Add what the calling thread counted since start
+void perf_since(PerfCounters *total, const PerfCounters *start) {
+    PerfCounters now;
+    perf_snapshot(&now);
+    total->bytes_read += now.bytes_read - start->bytes_read;
+    total->bytes_mapped += now.bytes_mapped - start->bytes_mapped;
+    total->io_calls += now.io_calls - start->io_calls;
+    total->allocations += now.allocations - start->allocations;
+    for (int i = 0; i < PERF_PHASE_COUNT; i++)
+        total->phase_ns[i] += now.phase_ns[i] - start->phase_ns[i];
+}
+
+void perf_add(PerfCounters *total, const PerfCounters *more) {
+    total->bytes_read += more->bytes_read;
+    total->bytes_mapped += more->bytes_mapped;
+    total->io_calls += more->io_calls;
+    total->allocations += more->allocations;
+    for (int i = 0; i < PERF_PHASE_COUNT; i++)
+        total->phase_ns[i] += more->phase_ns[i];
+}
@@ -0,0 +1,558 @@
+// Text report
+#include "afp_internal.h"
+
+// Function to print EBCDIC string in readable form
+void print_ebcdic_string(AFPWriter *out, const CodePage *codepage, const unsigned char *data, size_t length) {
+    writer_puts(out, "EBCDIC: ");
+    writer_ebcdic(out, codepage, data, length);
+    writer_puts(out, "\n");
+}
+
+void print_hex(AFPWriter *out, const unsigned char *data, size_t length) {
+    writer_hex(out, data, length);
+}
+
+void print_ebcdic_type(AFPWriter *out, const unsigned char *type) {
+    const SFTypeInfo *info = &sf_types[sf_type_id(type)];
+    
+    if (info->code == 0)
+        writer_printf(out, "EBCDIC Type: %02X%02X%02X (Unknown)\n", type[0], type[1], type[2]);
+    else
+        writer_printf(out, "EBCDIC Type: %02X%02X%02X (%s - %s)\n", type[0], type[1], type[2],
+                info->acronym, info->name);
+}
+
+void print_structure_summary(AFPWriter *out, const ContainerStack *stack, const CodePage *codepage, uint64_t page_count,
+                             uint64_t object_count,
+                             uint64_t resource_count) {
+    writer_puts(out, "\nAFP Structure Summary:\n");
+    writer_puts(out, "---------------------\n");
+    
+    if (stack->count > 0) {
+        char label[96];
+        writer_puts(out, "Warning: Document structure is incomplete. Unclosed components:\n");
+        
+        // Innermost first
+        for (size_t i = stack->count; i > 0; i--) {
+            container_label(&stack->items[i - 1], codepage, label, sizeof(label));
+            writer_printf(out, "  - %s\n", label);
+        }
+    } else {
+        writer_puts(out, "Document structure is properly nested and complete.\n");
+    }
+    
+    writer_puts(out, "\nContent Summary:\n");
+    writer_printf(out, "  - Pages: %llu\n", (unsigned long long)page_count);
+    writer_printf(out, "  - Objects: %llu\n", (unsigned long long)object_count);
+    writer_printf(out, "  - Resources: %llu\n", (unsigned long long)resource_count);
+}
+
+// Field types seen, in decreasing order of bytes
+static size_t sorted_field_types(const AFPStatistics *stats, int *types) {
+    size_t count = 0;
+    for (int id = 0; id < SF_TYPE_COUNT; id++) {
+        if (stats->types[id].count == 0)
+            continue;
+        // Insertion sort: there are only a few dozen types
+        size_t i = count++;
+        while (i > 0 && stats->types[types[i - 1]].bytes < stats->types[id].bytes) {
+            types[i] = types[i - 1];
+            i--;
+        }
+        types[i] = id;
+    }
+    return count;
+}
+
+static void print_field_types(AFPWriter *out, const AFPStatistics *stats) {
+    int types[SF_TYPE_COUNT];
+    size_t count = sorted_field_types(stats, types);
+    uint64_t total_bytes = 0;
+    uint64_t lengths[LENGTH_BUCKETS] = {0};
+    for (size_t i = 0; i < count; i++) {
+        const FieldTypeStatistics *type = &stats->types[types[i]];
+        total_bytes += type->bytes;
+        for (int b = 0; b < LENGTH_BUCKETS; b++)
+            lengths[b] += type->lengths[b];
+    }
+
+    writer_puts(out, "\nStructured Field Types:\n");
+    writer_puts(out, "----------------------\n");
+    writer_puts(out, "Type         Count           Bytes   Share  Largest\n");
+    for (size_t i = 0; i < count; i++) {
+        const FieldTypeStatistics *type = &stats->types[types[i]];
+        writer_printf(out, "%-6s %11llu %15llu %6.1f%% %8llu\n", types[i] == SF_UNKNOWN ? "?" : sf_types[types[i]].acronym,
+                      (unsigned long long)type->count, (unsigned long long)type->bytes,
+                      total_bytes ? 100.0 * (double)type->bytes / (double)total_bytes : 0.0,
+                      (unsigned long long)type->largest);
+    }
+
+    char range[32];
+    writer_puts(out, "\nField Sizes:\n");
+    for (int b = 0; b < LENGTH_BUCKETS; b++) {
+        if (lengths[b] == 0)
+            continue;
+        snprintf(range, sizeof(range), "%lu-%lu", 8ul << b, (16ul << b) - 1);
+        writer_printf(out, "  %13s bytes: %llu\n", range, (unsigned long long)lengths[b]);
+    }
+
+    if (stats->largest_page_count > 0) {
+        writer_puts(out, "\nLargest Pages:\n");
+        for (size_t i = 0; i < stats->largest_page_count; i++) {
+            const PageSize *page = &stats->largest_pages[i];
+            writer_printf(out, "  Page %llu at position %llu: %llu bytes\n", (unsigned long long)page->number,
+                          (unsigned long long)page->offset, (unsigned long long)page->size);
+        }
+    }
+}
+
+void print_statistics(AFPWriter *out, AFPStatistics *stats) {
+    writer_puts(out, "\nAFP Content Statistics:\n");
+    writer_puts(out, "----------------------\n");
+    writer_printf(out, "Documents:         %llu\n", (unsigned long long)stats->documents);
+    writer_printf(out, "Page Groups:       %llu\n", (unsigned long long)stats->page_groups);
+    writer_printf(out, "Pages:             %llu\n", (unsigned long long)stats->pages);
+    writer_printf(out, "Overlays:          %llu\n", (unsigned long long)stats->overlays);
+    writer_printf(out, "Resource Groups:   %llu\n", (unsigned long long)stats->resource_groups);
+    writer_printf(out, "Presentation Text: %llu\n", (unsigned long long)stats->presentation_text);
+    writer_printf(out, "Images:            %llu\n", (unsigned long long)stats->images);
+    writer_printf(out, "Graphics:          %llu\n", (unsigned long long)stats->graphics);
+    writer_printf(out, "Barcodes:          %llu\n", (unsigned long long)stats->barcodes);
+    writer_printf(out, "Fonts:             %llu\n", (unsigned long long)stats->fonts);
+    writer_printf(out, "Form Definitions:  %llu\n", (unsigned long long)stats->form_defs);
+    writer_printf(out, "Page Segments:     %llu\n", (unsigned long long)stats->page_segments);
+    print_field_types(out, stats);
+}
+
+// Keep a page if it is among the largest
+void statistics_add_page(AFPStatistics *stats, const PageSize *page) {
+    size_t i = stats->largest_page_count;
+    if (i == LARGEST_PAGES) {
+        if (page->size <= stats->largest_pages[i - 1].size)
+            return;
+        i--;
+    } else {
+        stats->largest_page_count++;
+    }
+    while (i > 0 && stats->largest_pages[i - 1].size < page->size) {
+        stats->largest_pages[i] = stats->largest_pages[i - 1];
+        i--;
+    }
+    stats->largest_pages[i] = *page;
+}
+
+// Fold the statistics of a chunk into those of everything before it
+void statistics_add(AFPStatistics *total, const AFPStatistics *part) {
+    for (size_t i = 0; i < part->largest_page_count; i++) {
+        PageSize page = part->largest_pages[i];
+        page.number += total->pages; // Chunks number their pages from 1
+        statistics_add_page(total, &page);
+    }
+    for (int id = 0; id < SF_TYPE_COUNT; id++) {
+        FieldTypeStatistics *type = &total->types[id];
+        const FieldTypeStatistics *more = &part->types[id];
+        type->count += more->count;
+        type->bytes += more->bytes;
+        for (int b = 0; b < LENGTH_BUCKETS; b++)
+            type->lengths[b] += more->lengths[b];
+        if (more->largest > type->largest) {
+            type->largest = more->largest;
+            type->largest_offset = more->largest_offset;
+        }
+    }
+    total->page_start = part->page_start;
+    total->page_open = part->page_open;
+    total->documents += part->documents;
+    total->page_groups += part->page_groups;
+    total->pages += part->pages;
+    total->overlays += part->overlays;
+    total->resource_groups += part->resource_groups;
+    total->presentation_text += part->presentation_text;
+    total->images += part->images;
+    total->graphics += part->graphics;
+    total->barcodes += part->barcodes;
+    total->fonts += part->fonts;
+    total->form_defs += part->form_defs;
+    total->page_segments += part->page_segments;
+}
+
+// Decoded triplets of a field in verbose mode
+void print_triplets(AFPWriter *out, TripletIterator *it, const CodePage *codepage) {
+    Triplet triplet;
+    bool first = true;
+    while (triplet_next(it, &triplet)) {
+        if (first)
+            writer_puts(out, "  Triplets:\n");
+        first = false;
+        writer_printf(out, "    X'%02X' %s (%u bytes)", triplet.id, get_triplet_name(triplet.id), triplet.length);
+        if (triplet.id == 0x02 && triplet.data_length > 2) {
+            // Character names are shown, OIDs and URLs are not
+            writer_printf(out, ": type X'%02X'", triplet.data[0]);
+            if (triplet.data[1] == 0x00) {
+                writer_puts(out, " ");
+                writer_ebcdic(out, codepage, triplet.data + 2, triplet.data_length - 2);
+            }
+        } else if (triplet.id == 0x01 && triplet.data_length >= 4) {
+            // GCSGID and CPGID, or a CCSID after a zero GCSGID
+            unsigned gcsgid = (unsigned)((triplet.data[0] << 8) | triplet.data[1]);
+            unsigned number = (unsigned)((triplet.data[2] << 8) | triplet.data[3]);
+            const CodePage *named = codepage_of_triplet(&triplet);
+            if (gcsgid)
+                writer_printf(out, ": GCSGID %u, CPGID %u", gcsgid, number);
+            else
+                writer_printf(out, ": CCSID %u", number);
+            writer_printf(out, " (%s)", named ? named->name : "unsupported code page");
+        }
+        writer_puts(out, "\n");
+    }
+    if (it->malformed) {
+        if (first)
+            writer_puts(out, "  Triplets:\n");
+        writer_puts(out, "    Malformed triplet: its length runs past the field\n");
+    }
+}
+
+// Names listed per category before the rest is only counted
+#define RESOURCE_LIST_LIMIT 50
+
+static void print_resource_list(AFPWriter *out, const char *label, const ResourceEntry **entries, size_t count,
+                                bool defined, const CodePage *codepage) {
+    char name[EBCDIC_NAME_SIZE];
+    for (size_t i = 0; i < count && i < RESOURCE_LIST_LIMIT; i++) {
+        resource_name(entries[i], codepage, name);
+        writer_printf(out, "  %s: %s %s at position %llu\n", label,
+                      get_resource_class_name((ResourceClass)entries[i]->resource_class), name,
+                      (unsigned long long)(defined ? entries[i]->definition : entries[i]->first_reference));
+    }
+    if (count > RESOURCE_LIST_LIMIT)
+        writer_printf(out, "  ... and %zu more\n", count - RESOURCE_LIST_LIMIT);
+}
+
+// Inline resources and the include/map references that use them. References
+// to resources that are not in the file are warnings: a print server may find
+// them in its resource libraries.
+void print_resource_references(AFPWriter *out, const ResourceTable *table, const CodePage *codepage) {
+    ResourceSummary summary;
+    if (table->count == 0)
+        return;
+
+    writer_puts(out, "\nResource References:\n");
+    writer_puts(out, "--------------------\n");
+    if (!resources_summarize(table, &summary)) {
+        writer_puts(out, "Warning: Not enough memory to resolve resource references\n");
+        return;
+    }
+    writer_printf(out, "Resources defined:     %zu\n", summary.defined);
+    writer_printf(out, "Resources referenced:  %zu (%llu references)\n", summary.referenced,
+                  (unsigned long long)summary.references);
+    writer_printf(out, "Unresolved references: %zu\n", summary.unresolved_count);
+    writer_printf(out, "Unused resources:      %zu\n", summary.unused_count);
+    print_resource_list(out, "Warning: Unresolved", summary.unresolved, summary.unresolved_count, false, codepage);
+    print_resource_list(out, "Unused", summary.unused, summary.unused_count, true, codepage);
+    if (table->failed) {
+        writer_puts(out, "Warning: Not enough memory to track every resource name\n");
+    }
+    resource_summary_free(&summary);
+}
+
+// Content hash of every inline resource, for spotting copies across files
+void print_fingerprints(AFPWriter *out, const FingerprintList *list, const CodePage *codepage) {
+    uint64_t bytes = 0;
+    char name[EBCDIC_NAME_SIZE];
+    for (size_t i = 0; i < list->count; i++)
+        bytes += list->items[i].size;
+
+    writer_puts(out, "\nResource Fingerprints:\n");
+    writer_puts(out, "---------------------\n");
+    writer_printf(out, "Inline resources hashed: %zu (%llu bytes)\n", list->count, (unsigned long long)bytes);
+    for (size_t i = 0; i < list->count && i < RESOURCE_LIST_LIMIT; i++) {
+        const ResourceFingerprint *print = &list->items[i];
+        fingerprint_name(print, codepage, name);
+        writer_printf(out, "  %016llX %10llu bytes  %-12s %-8s at position %llu\n", (unsigned long long)print->hash,
+                      (unsigned long long)print->size, get_resource_class_name((ResourceClass)print->resource_class),
+                      name, (unsigned long long)print->offset);
+    }
+    if (list->count > RESOURCE_LIST_LIMIT)
+        writer_printf(out, "  ... and %zu more\n", list->count - RESOURCE_LIST_LIMIT);
+}
+
+void print_validation_summary(ValidationState *state) {
+    AFPWriter *out = state->out;
+    
+    // Summary
+    writer_puts(out, "\nAFP File Analysis Summary:\n");
+    writer_puts(out, "-------------------------\n");
+    writer_printf(out, "Total structured fields: %llu\n", (unsigned long long)state->field_count);
+    writer_printf(out, "Errors detected: %llu\n", (unsigned long long)state->error_count);
+    if (state->skipped_bytes > 0) {
+        writer_printf(out, "Bytes skipped while resynchronizing: %llu\n", (unsigned long long)state->skipped_bytes);
+    }
+    
+    // A page range lies inside the document, its bounds were not scanned
+    if (!state->partial) {
+        writer_printf(out, "Begin Document found: %s\n", state->has_begin_document ? "Yes" : "No");
+        writer_printf(out, "End Document found: %s\n", state->has_end_document ? "Yes" : "No");
+        
+        if (!state->has_begin_document) {
+            writer_puts(out, "Warning: No Begin Document structured field found\n");
+        }
+        
+        if (!state->has_end_document) {
+            writer_puts(out, "Warning: No End Document structured field found\n");
+        }
+    }
+    
+    // Print structure summary
+    print_structure_summary(out, &state->containers, state->codepage, state->page_count,
+                            state->object_count, state->resource_count);
+    
+    // Print statistics
+    print_statistics(out, &state->stats);
+    
+    // A page range uses resources defined outside it
+    if (!state->partial) {
+        print_resource_references(out, &state->resources, state->codepage);
+        if (state->fingerprint) {
+            print_fingerprints(out, &state->fingerprints, state->codepage);
+        }
+    }
+    
+    writer_printf(out, "\nValidation result: %s\n", state->is_valid ? "VALID" : "INVALID");
+}
+
+#ifdef AFP_PERF
+static const char *perf_phase_names[PERF_PHASE_COUNT] = {"read", "decode", "validate", "print"};
+#endif
+
+void print_perf_summary(ValidationState *state) {
+    AFPWriter *out = state->out;
+    writer_puts(out, "\nPerformance Counters:\n");
+    writer_puts(out, "---------------------\n");
+#ifndef AFP_PERF
+    writer_puts(out, "Not compiled in; build with make PERF=1 to collect them\n");
+#else
+    const PerfCounters *counters = &state->perf_counters;
+    writer_printf(out, "Bytes read:       %llu\n", (unsigned long long)counters->bytes_read);
+    writer_printf(out, "Bytes mapped:     %llu\n", (unsigned long long)counters->bytes_mapped);
+    writer_printf(out, "I/O calls:        %llu\n", (unsigned long long)counters->io_calls);
+    writer_printf(out, "Allocations:      %llu\n", (unsigned long long)counters->allocations);
+    writer_printf(out, "Resync skipped:   %llu bytes\n", (unsigned long long)state->skipped_bytes);
+    for (int phase = 0; phase < PERF_PHASE_COUNT; phase++) {
+        writer_printf(out, "Time in %-9s %10.3f ms\n", perf_phase_names[phase],
+                      (double)counters->phase_ns[phase] / 1e6);
+    }
+    if (state->perf_threads > 1)
+        writer_printf(out, "  (times summed over %d threads)\n", state->perf_threads);
+#endif
+}
+
+// JSON reports. Every line is one object with an "event" member: "error",
+// "resync" and "field" events in JSON Lines format, then one "summary".
+static void json_event(JSONWriter *json, AFPWriter *out, const char *event, const char *source) {
+    json_begin(json, out);
+    json_string(json, "event", event);
+    json_string(json, "file", source);
+}
+
+void report_json_error(ValidationState *state, uint64_t position, const char *message) {
+    JSONWriter json;
+    json_event(&json, state->json, "error", state->source);
+    json_uint(&json, "position", position);
+    json_string(&json, "message", message);
+    json_end(&json);
+}
+
+void report_json_resync(ValidationState *state, uint64_t start, uint64_t skipped, bool found) {
+    JSONWriter json;
+    json_event(&json, state->json, "resync", state->source);
+    json_uint(&json, "position", start);
+    json_uint(&json, "skipped", skipped);
+    json_bool(&json, "end_of_input", !found);
+    json_end(&json);
+}
+
+void report_json_field(ValidationState *state, const StructuredField *field, uint64_t position) {
+    static const char hex_digits[] = "0123456789ABCDEF";
+    char type[7];
+    for (int i = 0; i < 3; i++) {
+        type[2 * i] = hex_digits[field->type[i] >> 4];
+        type[2 * i + 1] = hex_digits[field->type[i] & 0x0F];
+    }
+    type[6] = '\0';
+
+    JSONWriter json;
+    json_event(&json, state->json, "field", state->source);
+    json_uint(&json, "position", position);
+    json_uint(&json, "length", field->length);
+    json_string(&json, "type", type);
+    json_string(&json, "acronym", sf_types[field->id].acronym);
+    json_uint(&json, "flags", field->flags);
+    if (field->name[0] != 0) {
+        char name[EBCDIC_NAME_SIZE];
+        ebcdic_name(state->codepage, (const unsigned char *)field->name, strlen(field->name), name);
+        json_string(&json, "name", name);
+    }
+    json_end(&json);
+}
+
+// Names of a resource list, capped like the text report; the count is exact
+static void json_resource_names(JSONWriter *json, const char *key, const ResourceEntry **entries, size_t count,
+                                const CodePage *codepage) {
+    char name[EBCDIC_NAME_SIZE];
+    char count_key[32];
+    snprintf(count_key, sizeof(count_key), "%s_count", key);
+    json_uint(json, count_key, count);
+    json_array(json, key);
+    for (size_t i = 0; i < count && i < RESOURCE_LIST_LIMIT; i++) {
+        resource_name(entries[i], codepage, name);
+        json_object(json, NULL);
+        json_string(json, "name", name);
+        json_string(json, "class", get_resource_class_name((ResourceClass)entries[i]->resource_class));
+        json_close(json, '}');
+    }
+    json_close(json, ']');
+}
+
+void report_json_summary(ValidationState *state) {
+    JSONWriter json;
+    json_event(&json, state->json, "summary", state->source);
+    json_bool(&json, "opened", true);
+    json_bool(&json, "valid", state->is_valid);
+    json_uint(&json, "size", state->file_size);
+    json_uint(&json, "fields", state->field_count);
+    json_uint(&json, "errors", state->error_count);
+    json_uint(&json, "skipped_bytes", state->skipped_bytes);
+    if (!state->partial) {
+        json_bool(&json, "begin_document", state->has_begin_document);
+        json_bool(&json, "end_document", state->has_end_document);
+    }
+
+    // Outermost first
+    json_array(&json, "unclosed");
+    for (size_t i = 0; i < state->containers.count; i++) {
+        const OpenContainer *open = &state->containers.items[i];
+        SFTypeId id = (SFTypeId)sf_type_index[open->code];
+        char type[8];
+        char name[EBCDIC_NAME_SIZE];
+        if (id != SF_UNKNOWN)
+            snprintf(type, sizeof(type), "%s", sf_types[id].acronym);
+        else
+            snprintf(type, sizeof(type), "D3%04X", open->code);
+        ebcdic_name(state->codepage, (const unsigned char *)open->name, strlen(open->name), name);
+        json_object(&json, NULL);
+        json_string(&json, "type", type);
+        json_string(&json, "name", name);
+        json_uint(&json, "position", open->offset);
+        json_close(&json, '}');
+    }
+    json_close(&json, ']');
+
+    json_uint(&json, "pages", state->page_count);
+    json_uint(&json, "objects", state->object_count);
+    json_uint(&json, "resources", state->resource_count);
+
+    const AFPStatistics *stats = &state->stats;
+    json_object(&json, "statistics");
+    json_uint(&json, "documents", stats->documents);
+    json_uint(&json, "page_groups", stats->page_groups);
+    json_uint(&json, "pages", stats->pages);
+    json_uint(&json, "overlays", stats->overlays);
+    json_uint(&json, "resource_groups", stats->resource_groups);
+    json_uint(&json, "presentation_text", stats->presentation_text);
+    json_uint(&json, "images", stats->images);
+    json_uint(&json, "graphics", stats->graphics);
+    json_uint(&json, "barcodes", stats->barcodes);
+    json_uint(&json, "fonts", stats->fonts);
+    json_uint(&json, "form_defs", stats->form_defs);
+    json_uint(&json, "page_segments", stats->page_segments);
+    json_close(&json, '}');
+
+    // Every type that occurs, largest share of the bytes first
+    int types[SF_TYPE_COUNT];
+    size_t type_count = sorted_field_types(stats, types);
+    json_object(&json, "field_types");
+    for (size_t i = 0; i < type_count; i++) {
+        const FieldTypeStatistics *type = &stats->types[types[i]];
+        json_object(&json, types[i] == SF_UNKNOWN ? "unknown" : sf_types[types[i]].acronym);
+        json_uint(&json, "count", type->count);
+        json_uint(&json, "bytes", type->bytes);
+        json_uint(&json, "largest", type->largest);
+        json_uint(&json, "largest_position", type->largest_offset);
+        json_array(&json, "lengths"); // Histogram, see LENGTH_BUCKETS
+        for (int b = 0; b < LENGTH_BUCKETS; b++)
+            json_uint(&json, NULL, type->lengths[b]);
+        json_close(&json, ']');
+        json_close(&json, '}');
+    }
+    json_close(&json, '}');
+    json_array(&json, "largest_pages");
+    for (size_t i = 0; i < stats->largest_page_count; i++) {
+        json_object(&json, NULL);
+        json_uint(&json, "page", stats->largest_pages[i].number);
+        json_uint(&json, "position", stats->largest_pages[i].offset);
+        json_uint(&json, "size", stats->largest_pages[i].size);
+        json_close(&json, '}');
+    }
+    json_close(&json, ']');
+
+    ResourceSummary summary;
+    if (!state->partial && state->resources.count > 0 && resources_summarize(&state->resources, &summary)) {
+        json_object(&json, "resource_references");
+        json_uint(&json, "defined", summary.defined);
+        json_uint(&json, "referenced", summary.referenced);
+        json_uint(&json, "references", summary.references);
+        json_resource_names(&json, "unresolved", summary.unresolved, summary.unresolved_count, state->codepage);
+        json_resource_names(&json, "unused", summary.unused, summary.unused_count, state->codepage);
+        json_bool(&json, "complete", !state->resources.failed);
+        json_close(&json, '}');
+        resource_summary_free(&summary);
+    }
+
+    if (!state->partial && state->fingerprint) {
+        char hash[17];
+        char name[EBCDIC_NAME_SIZE];
+        json_array(&json, "fingerprints");
+        for (size_t i = 0; i < state->fingerprints.count; i++) {
+            const ResourceFingerprint *print = &state->fingerprints.items[i];
+            fingerprint_name(print, state->codepage, name);
+            snprintf(hash, sizeof(hash), "%016llX", (unsigned long long)print->hash);
+            json_object(&json, NULL);
+            json_string(&json, "name", name);
+            json_string(&json, "class", get_resource_class_name((ResourceClass)print->resource_class));
+            json_uint(&json, "position", print->offset);
+            json_uint(&json, "size", print->size);
+            json_string(&json, "xxh64", hash);
+            json_close(&json, '}');
+        }
+        json_close(&json, ']');
+    }
+
+#ifdef AFP_PERF
+    if (state->perf) {
+        const PerfCounters *counters = &state->perf_counters;
+        json_object(&json, "performance");
+        json_uint(&json, "bytes_read", counters->bytes_read);
+        json_uint(&json, "bytes_mapped", counters->bytes_mapped);
+        json_uint(&json, "io_calls", counters->io_calls);
+        json_uint(&json, "allocations", counters->allocations);
+        json_uint(&json, "resync_bytes", state->skipped_bytes);
+        json_uint(&json, "threads", (uint64_t)state->perf_threads);
+        json_object(&json, "phase_ns");
+        for (int phase = 0; phase < PERF_PHASE_COUNT; phase++)
+            json_uint(&json, perf_phase_names[phase], counters->phase_ns[phase]);
+        json_close(&json, '}');
+        json_close(&json, '}');
+    }
+#endif
+    json_end(&json);
+}
+
+// Summary of an input that could not be validated at all
+void report_json_failure(AFPWriter *out, const char *source, const char *message) {
+    JSONWriter json;
+    json_event(&json, out, "summary", source);
+    json_bool(&json, "opened", false);
+    json_bool(&json, "valid", false);
+    json_string(&json, "message", message);
+    json_end(&json);
+}
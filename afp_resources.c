@@ -0,0 +1,338 @@
+// Resource reference table. Names defined by inline resources (BRS, BMO,
+// BPS) and names referenced by include and map fields (IPS, IPO, IOB, MPS,
+// MPO, MCF) share one open-addressing hash table keyed on the 8-byte EBCDIC
+// name and the resource class, so memory grows with the number of distinct
+// resources rather than the number of references.
+#include "afp_internal.h"
+
+#define RESOURCE_TABLE_MIN 256
+
+// Resource Object Type triplet (X'21') values of a BRS
+static ResourceClass resource_class_of_object_type(unsigned char type) {
+    switch (type) {
+        case 0x40: // Font character set
+        case 0x41: // Code page
+        case 0x42: // Coded font
+            return RESOURCE_FONT;
+        case 0xFB: return RESOURCE_PAGE_SEGMENT;
+        case 0xFC: return RESOURCE_OVERLAY;
+        default:   return RESOURCE_OBJECT;
+    }
+}
+
+const char *get_resource_class_name(ResourceClass resource_class) {
+    switch (resource_class) {
+        case RESOURCE_OVERLAY: return "Overlay";
+        case RESOURCE_PAGE_SEGMENT: return "Page Segment";
+        case RESOURCE_FONT: return "Font";
+        case RESOURCE_OBJECT: return "Object";
+        default: return "Resource";
+    }
+}
+
+static size_t resource_hash(const unsigned char *name, ResourceClass resource_class) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; i++) {
+        hash ^= name[i];
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= (uint64_t)resource_class;
+    hash *= 0x100000001b3ULL;
+    return (size_t)(hash ^ (hash >> 32));
+}
+
+// Slot of (name, class): the entry itself or the empty slot where it belongs
+static ResourceEntry *resources_slot(ResourceEntry *entries, size_t capacity, const unsigned char *name,
+                                     ResourceClass resource_class) {
+    size_t mask = capacity - 1;
+    size_t i = resource_hash(name, resource_class) & mask;
+    for (;;) {
+        ResourceEntry *entry = &entries[i];
+        if (!entry->used ||
+            (entry->resource_class == resource_class && memcmp(entry->name, name, 8) == 0))
+            return entry;
+        i = (i + 1) & mask;
+    }
+}
+
+const ResourceEntry *resources_find(const ResourceTable *table, const unsigned char *name,
+                                    ResourceClass resource_class) {
+    if (table->capacity == 0)
+        return NULL;
+    ResourceEntry *entry = resources_slot(table->entries, table->capacity, name, resource_class);
+    return entry->used ? entry : NULL;
+}
+
+// Double the table once it is 3/4 full
+static bool resources_grow(ResourceTable *table) {
+    if (table->failed)
+        return false;
+    if ((table->count + 1) * 4 <= table->capacity * 3)
+        return true;
+
+    size_t capacity = table->capacity ? table->capacity * 2 : RESOURCE_TABLE_MIN;
+    ResourceEntry *entries = calloc(capacity, sizeof(ResourceEntry));
+    PERF_COUNT(allocations, 1);
+    if (!entries) {
+        table->failed = true;
+        return false;
+    }
+    for (size_t i = 0; i < table->capacity; i++) {
+        ResourceEntry *entry = &table->entries[i];
+        if (entry->used)
+            *resources_slot(entries, capacity, entry->name, (ResourceClass)entry->resource_class) = *entry;
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+    return true;
+}
+
+static ResourceEntry *resources_entry(ResourceTable *table, const unsigned char *name,
+                                      ResourceClass resource_class) {
+    if (!resources_grow(table))
+        return NULL;
+    ResourceEntry *entry = resources_slot(table->entries, table->capacity, name, resource_class);
+    if (!entry->used) {
+        memcpy(entry->name, name, 8);
+        entry->resource_class = (unsigned char)resource_class;
+        entry->used = true;
+        table->count++;
+    }
+    return entry;
+}
+
+void resources_define(ResourceTable *table, const unsigned char *name, ResourceClass resource_class,
+                      uint64_t position) {
+    ResourceEntry *entry = resources_entry(table, name, resource_class);
+    if (entry && !entry->defined) {
+        entry->defined = true;
+        entry->definition = position;
+    }
+}
+
+void resources_reference(ResourceTable *table, const unsigned char *name, ResourceClass resource_class,
+                         uint64_t position) {
+    ResourceEntry *entry = resources_entry(table, name, resource_class);
+    if (entry && entry->references++ == 0)
+        entry->first_reference = position;
+}
+
+// Whether a field begins an inline resource, and the class of that resource.
+// The name is the first 8 payload bytes; field->length must be at least 16.
+bool resource_definition(const StructuredField *field, ResourceClass *resource_class) {
+    switch (field->id) {
+        case SF_BRS: {
+            // Class from the Resource Object Type triplet, if there is one
+            TripletIterator it;
+            Triplet triplet;
+            *resource_class = RESOURCE_ANY;
+            if (!triplets_of_field(&it, field))
+                return true;
+            while (triplet_next(&it, &triplet)) {
+                if (triplet.id == 0x21 && triplet.data_length >= 1) {
+                    *resource_class = resource_class_of_object_type(triplet.data[0]);
+                    break;
+                }
+            }
+            return true;
+        }
+        case SF_BMO:
+            *resource_class = RESOURCE_OVERLAY;
+            return true;
+        case SF_BPS:
+            *resource_class = RESOURCE_PAGE_SEGMENT;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// References in the Fully Qualified Name triplets (X'02') of an MPO or MCF:
+// length, id, FQN type, format, name
+static void resources_map_names(ResourceTable *table, const StructuredField *field, ResourceClass resource_class,
+                                uint64_t position) {
+    TripletIterator it;
+    Triplet triplet;
+    if (!triplets_of_field(&it, field))
+        return;
+    while (triplet_next(&it, &triplet)) {
+        if (triplet.id != 0x02 || triplet.data_length < 2 + 8)
+            continue;
+        unsigned char type = triplet.data[0];
+        if (type == 0x84 || type == 0x85 || type == 0x86 || type == 0x8E)
+            resources_reference(table, triplet.data + 2, resource_class, position);
+    }
+}
+
+// Record the definitions and references carried by a field
+void resources_collect(ResourceTable *table, const StructuredField *field, uint64_t position) {
+    if (field->length < 16 || !field->data)
+        return; // No room for a name, or a payload skipped by a structure-only run
+    const unsigned char *payload = field->data + 2; // After the reserved bytes
+    size_t length = (size_t)field->length - 8;
+
+    ResourceClass resource_class;
+    if (resource_definition(field, &resource_class)) {
+        resources_define(table, payload, resource_class, position);
+        return;
+    }
+
+    switch (field->id) {
+        case SF_IPO:
+            resources_reference(table, payload, RESOURCE_OVERLAY, position);
+            break;
+        case SF_IPS:
+            resources_reference(table, payload, RESOURCE_PAGE_SEGMENT, position);
+            break;
+        case SF_IOB:
+            resources_reference(table, payload, RESOURCE_OBJECT, position);
+            break;
+        case SF_MPS:
+            // Repeating groups: length(1), reserved(3), name(8)
+            while (length >= 12 && payload[0] >= 12 && payload[0] <= length) {
+                resources_reference(table, payload + 4, RESOURCE_PAGE_SEGMENT, position);
+                length -= payload[0];
+                payload += payload[0];
+            }
+            break;
+        case SF_MPO:
+            resources_map_names(table, field, RESOURCE_OVERLAY, position);
+            break;
+        case SF_MCF:
+            resources_map_names(table, field, RESOURCE_FONT, position);
+            break;
+        default:
+            break;
+    }
+}
+
+// A reference is resolved by a definition of its class or by an untyped BRS
+bool resource_resolved(const ResourceTable *table, const ResourceEntry *entry) {
+    if (entry->defined)
+        return true;
+    const ResourceEntry *any = resources_find(table, entry->name, RESOURCE_ANY);
+    return any && any->defined;
+}
+
+// A definition is used when its name is referenced; untyped ones by any class
+bool resource_used(const ResourceTable *table, const ResourceEntry *entry) {
+    if (entry->references > 0)
+        return true;
+    if (entry->resource_class != RESOURCE_ANY)
+        return false;
+    for (int c = RESOURCE_ANY + 1; c < RESOURCE_CLASS_COUNT; c++) {
+        const ResourceEntry *other = resources_find(table, entry->name, (ResourceClass)c);
+        if (other && other->references > 0)
+            return true;
+    }
+    return false;
+}
+
+// An untyped BRS wrapping a BMO or BPS of the same name defines that resource
+static bool resource_wrapper(const ResourceTable *table, const ResourceEntry *entry) {
+    if (entry->resource_class != RESOURCE_ANY)
+        return false;
+    for (int c = RESOURCE_ANY + 1; c < RESOURCE_CLASS_COUNT; c++) {
+        const ResourceEntry *other = resources_find(table, entry->name, (ResourceClass)c);
+        if (other && other->defined)
+            return true;
+    }
+    return false;
+}
+
+// Fold the table of a later chunk into dst
+void resources_merge(ResourceTable *dst, const ResourceTable *src) {
+    if (src->failed)
+        dst->failed = true;
+    for (size_t i = 0; i < src->capacity; i++) {
+        const ResourceEntry *from = &src->entries[i];
+        if (!from->used)
+            continue;
+        ResourceEntry *to = resources_entry(dst, from->name, (ResourceClass)from->resource_class);
+        if (!to)
+            return;
+        if (from->defined && !to->defined) {
+            to->defined = true;
+            to->definition = from->definition;
+        }
+        if (from->references > 0 && to->references == 0)
+            to->first_reference = from->first_reference;
+        to->references += from->references;
+    }
+}
+
+// Put back an entry saved by a checkpoint
+bool resources_restore(ResourceTable *table, const ResourceEntry *saved) {
+    ResourceEntry *entry = resources_entry(table, saved->name, (ResourceClass)saved->resource_class);
+    if (!entry)
+        return false;
+    entry->defined = saved->defined;
+    entry->references = saved->references;
+    entry->definition = saved->definition;
+    entry->first_reference = saved->first_reference;
+    return true;
+}
+
+void resources_free(ResourceTable *table) {
+    free(table->entries);
+    memset(table, 0, sizeof(*table));
+}
+
+// ASCII name without the trailing blanks
+void resource_name(const ResourceEntry *entry, const CodePage *codepage, char name[EBCDIC_NAME_SIZE]) {
+    ebcdic_name(codepage, entry->name, 8, name);
+}
+
+static int compare_references(const void *a, const void *b) {
+    uint64_t x = (*(const ResourceEntry * const *)a)->first_reference;
+    uint64_t y = (*(const ResourceEntry * const *)b)->first_reference;
+    return (x > y) - (x < y);
+}
+
+static int compare_definitions(const void *a, const void *b) {
+    uint64_t x = (*(const ResourceEntry * const *)a)->definition;
+    uint64_t y = (*(const ResourceEntry * const *)b)->definition;
+    return (x > y) - (x < y);
+}
+
+bool resources_summarize(const ResourceTable *table, ResourceSummary *summary) {
+    memset(summary, 0, sizeof(*summary));
+    if (table->count == 0)
+        return true;
+
+    summary->unresolved = malloc(table->count * sizeof(ResourceEntry *));
+    summary->unused = malloc(table->count * sizeof(ResourceEntry *));
+    if (!summary->unresolved || !summary->unused) {
+        resource_summary_free(summary);
+        return false;
+    }
+
+    for (size_t i = 0; i < table->capacity; i++) {
+        const ResourceEntry *entry = &table->entries[i];
+        if (!entry->used)
+            continue;
+        if (entry->defined && !resource_wrapper(table, entry)) {
+            summary->defined++;
+            if (!resource_used(table, entry))
+                summary->unused[summary->unused_count++] = entry;
+        }
+        if (entry->references > 0) {
+            summary->referenced++;
+            summary->references += entry->references;
+            if (!resource_resolved(table, entry))
+                summary->unresolved[summary->unresolved_count++] = entry;
+        }
+    }
+
+    // Table order depends on the hash; report in file order
+    qsort(summary->unresolved, summary->unresolved_count, sizeof(ResourceEntry *), compare_references);
+    qsort(summary->unused, summary->unused_count, sizeof(ResourceEntry *), compare_definitions);
+    return true;
+}
+
+void resource_summary_free(ResourceSummary *summary) {
+    free(summary->unresolved);
+    free(summary->unused);
+    memset(summary, 0, sizeof(*summary));
+}
@@ -0,0 +1,253 @@
+// Input scanner over memory-mapped files, caller buffers and streams
+#include "afp_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AFP_HAVE_MMAP 1
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include <sys/stat.h>
+
+// Open file for scanning, mapping it when the platform allows.
+// A filename of "-" reads standard input.
+bool scanner_open(AFPScanner *scanner, const char *filename) {
+    memset(scanner, 0, sizeof(*scanner));
+
+    if (strcmp(filename, "-") == 0) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        scanner->file = stdin;
+        scanner->streaming = true;
+    } else {
+#ifdef AFP_HAVE_MMAP
+        int fd = open(filename, O_RDONLY);
+        PERF_COUNT(io_calls, 2); // open, fstat
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+        if (regular && st.st_size > 0 && (uint64_t)st.st_size <= SIZE_MAX) {
+            void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            PERF_COUNT(io_calls, 1);
+            if (map != MAP_FAILED) {
+                madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+                close(fd);
+                PERF_COUNT(io_calls, 2);
+                PERF_COUNT(bytes_mapped, st.st_size);
+                scanner->map = map;
+                scanner->mapped = true;
+                scanner->size = (uint64_t)st.st_size;
+                return true;
+            }
+        }
+
+        scanner->file = fdopen(fd, "rb");
+        if (!scanner->file) {
+            close(fd);
+            return false;
+        }
+        if (regular)
+            scanner->size = (uint64_t)st.st_size;
+        else
+            scanner->streaming = true;
+#else
+        scanner->file = fopen(filename, "rb");
+        if (!scanner->file)
+            return false;
+
+        // Only probe the size of seekable inputs
+        int64_t size = -1;
+        if (afp_fseek(scanner->file, 0, SEEK_END) == 0)
+            size = (int64_t)afp_ftell(scanner->file);
+        if (size >= 0 && afp_fseek(scanner->file, 0, SEEK_SET) == 0)
+            scanner->size = (uint64_t)size;
+        else
+            scanner->streaming = true;
+#endif
+    }
+
+    scanner->window = malloc(SCANNER_WINDOW_SIZE);
+    PERF_COUNT(allocations, 1);
+    if (!scanner->window) {
+        if (scanner->file != stdin)
+            fclose(scanner->file);
+        scanner->file = NULL;
+        return false;
+    }
+    return true;
+}
+
+// Scan an AFP buffer owned by the caller, in place like a mapped file
+void scanner_open_buffer(AFPScanner *scanner, const unsigned char *data, size_t size) {
+    memset(scanner, 0, sizeof(*scanner));
+    scanner->map = data ? data : (const unsigned char *)""; // Never NULL, NULL means buffered
+    scanner->size = data ? size : 0;
+}
+
+void scanner_close(AFPScanner *scanner) {
+#ifdef AFP_HAVE_MMAP
+    if (scanner->mapped)
+        munmap((void *)scanner->map, (size_t)scanner->size);
+#endif
+    if (scanner->file && scanner->file != stdin)
+        fclose(scanner->file);
+    free(scanner->window);
+    memset(scanner, 0, sizeof(*scanner));
+}
+
+// Move unread bytes to the front of the window and read until it holds want bytes
+static void scanner_fill(AFPScanner *scanner, size_t want) {
+    size_t unread = scanner->window_len - scanner->window_start;
+    if (scanner->window_start > 0) {
+        memmove(scanner->window, scanner->window + scanner->window_start, unread);
+        scanner->window_start = 0;
+        scanner->window_len = unread;
+    }
+
+    while (scanner->window_len < want) {
+        size_t room = scanner->sparse ? want : SCANNER_WINDOW_SIZE;
+        size_t got = fread(scanner->window + scanner->window_len, 1,
+                           room - scanner->window_len, scanner->file);
+        PERF_COUNT(io_calls, 1);
+        PERF_COUNT(bytes_read, got);
+        if (got == 0) {
+            if (ferror(scanner->file))
+                scanner->error = true;
+            break;
+        }
+        scanner->window_len += got;
+    }
+}
+
+// Return a pointer to the next want bytes without consuming them.
+// *avail receives how many of them are actually present (less at end of input).
+const unsigned char *scanner_peek(AFPScanner *scanner, size_t want, size_t *avail) {
+    if (scanner->map) {
+        uint64_t left = scanner->size - scanner->position;
+        *avail = left < want ? (size_t)left : want;
+        return scanner->map + scanner->position;
+    }
+
+    if (want > SCANNER_WINDOW_SIZE)
+        want = SCANNER_WINDOW_SIZE;
+    if (scanner->window_len - scanner->window_start < want)
+        scanner_fill(scanner, want);
+
+    size_t left = scanner->window_len - scanner->window_start;
+    *avail = left < want ? left : want;
+    return scanner->window + scanner->window_start;
+}
+
+// Consume count bytes
+void scanner_skip(AFPScanner *scanner, size_t count) {
+    scanner->position += count;
+    if (scanner->map)
+        return;
+
+    size_t left = scanner->window_len - scanner->window_start;
+    if (count <= left) {
+        scanner->window_start += count;
+        return;
+    }
+
+    // Skipping past the window: drop it and seek or read over the rest
+    count -= left;
+    scanner->window_start = scanner->window_len = 0;
+    if (scanner->sparse) {
+        PERF_COUNT(io_calls, 1);
+        if (afp_fseek(scanner->file, (int64_t)count, SEEK_CUR) != 0)
+            scanner->error = true;
+        return;
+    }
+    while (count > 0) {
+        size_t chunk = count < SCANNER_WINDOW_SIZE ? count : SCANNER_WINDOW_SIZE;
+        size_t got = fread(scanner->window, 1, chunk, scanner->file);
+        PERF_COUNT(io_calls, 1);
+        PERF_COUNT(bytes_read, got);
+        if (got == 0)
+            break;
+        count -= got;
+    }
+}
+
+// Jump to an absolute offset of a file. Streams cannot seek.
+bool scanner_seek(AFPScanner *scanner, uint64_t offset) {
+    if (scanner->streaming || offset > scanner->size)
+        return false;
+    if (!scanner->map) {
+        PERF_COUNT(io_calls, 1);
+        if (offset > INT64_MAX || afp_fseek(scanner->file, (int64_t)offset, SEEK_SET) != 0)
+            return false;
+        scanner->window_start = scanner->window_len = 0;
+    }
+    scanner->position = offset;
+    return true;
+}
+
+// Only field headers and a few small payloads will be read. A mapping
+// already faults in just what is touched; a seekable file stops filling the
+// whole window and seeks over what is skipped.
+void scanner_sparse(AFPScanner *scanner) {
+    scanner->sparse = scanner->file && !scanner->streaming;
+}
+
+// Advance to the next occurrence of byte. Returns false at end of input.
+bool scanner_find(AFPScanner *scanner, unsigned char byte) {
+    for (;;) {
+        size_t avail;
+        const unsigned char *p = scanner_peek(scanner, SCANNER_WINDOW_SIZE, &avail);
+        if (avail == 0)
+            return false;
+
+        const unsigned char *hit = memchr(p, byte, avail);
+        if (hit) {
+            scanner_skip(scanner, (size_t)(hit - p));
+            return true;
+        }
+        scanner_skip(scanner, avail);
+    }
+}
+
+// Whether the next count headers from the position chain by their lengths
+// onto valid introducers (0x5A, length of at least 8, class 0xD3), or input
+// ends cleanly after at least one of them
+bool scanner_chain_plausible(AFPScanner *scanner, int count) {
+    size_t offset = 0;
+
+    for (int i = 0; i < count; i++) {
+        size_t avail;
+        const unsigned char *p = scanner_peek(scanner, offset + 9, &avail);
+        if (avail <= offset)
+            return i > 0 && avail == offset;
+        if (avail < offset + 9)
+            return false;
+
+        p += offset;
+        uint16_t length = (p[1] << 8) | p[2];
+        if (p[0] != SF_INTRODUCER || p[3] != 0xD3 || length < 8)
+            return false;
+        offset += 1 + (size_t)length;
+    }
+    return true;
+}
+
+// Skip the corrupt byte at the current position and everything up to the
+// next plausible structured field. Returns false when input ran out first.
+bool scanner_resync(AFPScanner *scanner) {
+    scanner_skip(scanner, 1);
+    while (scanner_find(scanner, SF_INTRODUCER)) {
+        if (scanner_chain_plausible(scanner, RESYNC_CHAIN_LENGTH))
+            return true;
+        scanner_skip(scanner, 1);
+    }
+    return false;
+}
@@ -0,0 +1,355 @@
+// Splitting into self-contained AFP files. Parts are cut on the field
+// records of the offset index. Their bytes are copied straight from the
+// input, inside the kernel where the platform allows, and only the end
+// fields that close the wrapper of a part are written by hand.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // copy_file_range
+#endif
+#include "afp_internal.h"
+
+#include <stdarg.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define AFP_HAVE_FD 1
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#define SPLIT_BUFFER_SIZE (1 << 20)
+#define SPLIT_KERNEL_MAX (1 << 30) // Bytes per kernel copy call
+
+// Ways of copying a byte range, tried in this order until one works
+typedef enum {
+    COPY_FILE_RANGE, // Within a file system, possibly sharing the blocks
+    COPY_SENDFILE,   // To any file
+    COPY_BUFFERED
+} CopyMethod;
+
+typedef struct {
+#ifdef AFP_HAVE_FD
+    int in;
+    int out;
+#else
+    FILE *in;
+    FILE *out;
+#endif
+    CopyMethod method;
+    unsigned char *buffer; // Buffered copies, allocated on first use
+    AFPSplitResult *result;
+} SplitOutput;
+
+// A begin field whose end has not been reached
+typedef struct {
+    uint64_t position;
+    uint16_t length;
+    unsigned char code; // Last type byte, shared with the end field
+} OpenField;
+
+// Walk over the field records, keeping the containers open at the walk position
+typedef struct {
+    const AFPIndex *index;
+    size_t next;          // Next record to apply
+    OpenField *open;      // Outermost first
+    size_t depth;
+    size_t capacity;
+    uint64_t medium_map;  // Offset of the last Invoke Medium Map, UINT64_MAX for none
+    uint16_t medium_map_length;
+} SplitWalk;
+
+static bool split_fail(AFPSplitResult *result, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(result->error, sizeof(result->error), format, args);
+    va_end(args);
+    return false;
+}
+
+static bool split_read_at(SplitOutput *output, uint64_t offset, unsigned char *data, size_t length) {
+#ifdef AFP_HAVE_FD
+    while (length > 0) {
+        ssize_t count = pread(output->in, data, length, (off_t)offset);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        data += count;
+        offset += (uint64_t)count;
+        length -= (size_t)count;
+    }
+    return true;
+#else
+    return afp_fseek(output->in, (int64_t)offset, SEEK_SET) == 0 && fread(data, 1, length, output->in) == length;
+#endif
+}
+
+static bool split_write(SplitOutput *output, const unsigned char *data, size_t length) {
+#ifdef AFP_HAVE_FD
+    while (length > 0) {
+        ssize_t count = write(output->out, data, length);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        data += count;
+        length -= (size_t)count;
+    }
+    return true;
+#else
+    return fwrite(data, 1, length, output->out) == length;
+#endif
+}
+
+// Append length bytes at offset of the input to the part
+static bool split_copy(SplitOutput *output, uint64_t offset, uint64_t length) {
+#ifdef __linux__
+    while (length > 0 && output->method != COPY_BUFFERED) {
+        size_t count = length < SPLIT_KERNEL_MAX ? (size_t)length : SPLIT_KERNEL_MAX;
+        off_t from = (off_t)offset;
+        ssize_t copied = output->method == COPY_FILE_RANGE
+                             ? copy_file_range(output->in, &from, output->out, NULL, count, 0)
+                             : sendfile(output->out, output->in, &from, count);
+        if (copied < 0 && errno == EINTR)
+            continue;
+        if (copied == 0)
+            return false; // The input is shorter than its index
+        if (copied < 0) {
+            // Not supported by the kernel or these file systems: the next method
+            if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)
+                return false;
+            output->method++;
+            continue;
+        }
+        offset += (uint64_t)copied;
+        length -= (uint64_t)copied;
+        output->result->kernel_bytes += (uint64_t)copied;
+    }
+#endif
+    if (length > 0 && !output->buffer && !(output->buffer = malloc(SPLIT_BUFFER_SIZE)))
+        return false;
+    while (length > 0) {
+        size_t count = length < SPLIT_BUFFER_SIZE ? (size_t)length : SPLIT_BUFFER_SIZE;
+        if (!split_read_at(output, offset, output->buffer, count) || !split_write(output, output->buffer, count))
+            return false;
+        offset += count;
+        length -= count;
+        output->result->buffered_bytes += count;
+    }
+    return true;
+}
+
+// Apply the records before position: a begin field opens a container, an
+// end field closes the innermost container of its type and what it holds
+static bool split_advance(SplitWalk *walk, uint64_t position) {
+    const AFPIndex *index = walk->index;
+    while (walk->next < index->record_count) {
+        const unsigned char *record = index->records + walk->next * INDEX_RECORD_SIZE;
+        uint64_t offset = get_le(record, 8);
+        if (offset >= position)
+            break;
+        walk->next++;
+
+        const unsigned char *type = record + 14;
+        uint16_t length = (uint16_t)get_le(record + 12, 2);
+        if (type[0] != 0xD3)
+            continue;
+        if (type[1] == 0xA8) {
+            if (!array_reserve((void **)&walk->open, &walk->capacity, walk->depth + 1, sizeof(OpenField)))
+                return false;
+            OpenField *open = &walk->open[walk->depth++];
+            open->position = offset;
+            open->length = length;
+            open->code = type[2];
+        } else if (type[1] == 0xA9) {
+            for (size_t i = walk->depth; i-- > 0;) {
+                if (walk->open[i].code == type[2]) {
+                    walk->depth = i;
+                    break;
+                }
+            }
+        } else if (sf_type_id(type) == SF_IMM) {
+            walk->medium_map = offset;
+            walk->medium_map_length = length;
+        }
+    }
+    return true;
+}
+
+// End field for a begin field, with its name when it has one
+static bool split_end_field(SplitOutput *output, const OpenField *open) {
+    unsigned char field[17] = {SF_INTRODUCER, 0x00, 0x08, 0xD3, 0xA9, open->code, 0x00, 0x00, 0x00};
+    size_t size = 9;
+    if (open->length >= 16) {
+        if (!split_read_at(output, open->position + 9, field + 9, 8))
+            return false;
+        size = 17;
+    }
+    field[2] = (unsigned char)(size - 1);
+    output->result->synthesized_bytes += size;
+    return split_write(output, field, size);
+}
+
+// End of the head of a document: its Begin Document and what comes before
+// the first page or page group, such as its resource group and medium map
+static uint64_t document_head_end(const AFPIndex *index, uint64_t document, uint64_t first_page) {
+    size_t low = 0, high = index->record_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (get_le(index->records + middle * INDEX_RECORD_SIZE, 8) < document)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    for (size_t i = low; i < index->record_count; i++) {
+        const unsigned char *record = index->records + i * INDEX_RECORD_SIZE;
+        uint64_t offset = get_le(record, 8);
+        SFTypeId id = sf_type_id(record + 14);
+        if (offset >= first_page || id == SF_BPG || id == SF_BNG)
+            return offset < first_page ? offset : first_page;
+    }
+    return first_page;
+}
+
+// Write one part: the bytes before the first document (the print file
+// resources), then for a part that starts after the first page of its
+// document the document head, the begin fields still open at start and the
+// last medium map after the head, the input from start to end, then end
+// fields for every container still open
+static bool split_part(SplitOutput *output, SplitWalk *walk, const char *path, uint64_t prologue,
+                       uint64_t document, uint64_t head_end, uint64_t start, uint64_t end) {
+    if (!split_advance(walk, start))
+        return split_fail(output->result, "Memory allocation failed");
+#ifdef AFP_HAVE_FD
+    output->out = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (output->out < 0)
+        return split_fail(output->result, "Cannot create part file %s", path);
+#else
+    output->out = fopen(path, "wb");
+    if (!output->out)
+        return split_fail(output->result, "Cannot create part file %s", path);
+#endif
+
+    bool ok = split_copy(output, 0, prologue);
+    if (start > document) {
+        ok = ok && split_copy(output, document, head_end - document);
+        for (size_t i = 0; ok && i < walk->depth; i++) {
+            uint64_t position = walk->open[i].position;
+            if (position >= prologue && (position < document || position >= head_end))
+                ok = split_copy(output, position, 1 + (uint64_t)walk->open[i].length);
+        }
+        if (ok && walk->medium_map != UINT64_MAX && walk->medium_map >= head_end)
+            ok = split_copy(output, walk->medium_map, 1 + (uint64_t)walk->medium_map_length);
+    }
+    ok = ok && split_copy(output, start, end - start);
+    bool walked = split_advance(walk, end);
+    for (size_t i = walk->depth; ok && walked && i-- > 0;)
+        ok = split_end_field(output, &walk->open[i]);
+
+#ifdef AFP_HAVE_FD
+    ok = close(output->out) == 0 && ok;
+#else
+    ok = fclose(output->out) == 0 && ok;
+#endif
+    if (!ok || !walked) {
+        remove(path);
+        return walked ? split_fail(output->result, "Cannot write part file %s", path)
+                      : split_fail(output->result, "Memory allocation failed");
+    }
+    output->result->parts++;
+    return true;
+}
+
+bool afp_split(const char *filename, bool use_index, uint32_t pages_per_part, const char *prefix,
+               AFPSplitResult *result) {
+    memset(result, 0, sizeof(*result));
+    AFPScanner scanner;
+    if (!scanner_open(&scanner, filename))
+        return split_fail(result, "Cannot open file %s", filename);
+    if (scanner.streaming) {
+        scanner_close(&scanner);
+        return split_fail(result, "Splitting needs a seekable file, not a stream");
+    }
+
+    AFPIndex index;
+    bool from_index;
+    bool loaded = load_page_table(filename, &scanner, use_index, &index, &from_index);
+    uint64_t file_size = scanner.size;
+    scanner_close(&scanner);
+    if (!loaded) {
+        index_free(&index);
+        return split_fail(result, "Cannot build the page table of %s", filename);
+    }
+    if (index.document_count == 0) {
+        index_free(&index);
+        return split_fail(result, "%s has no Begin Document to split at", filename);
+    }
+
+    SplitOutput output;
+    memset(&output, 0, sizeof(output));
+    output.result = result;
+#ifdef AFP_HAVE_FD
+    output.in = open(filename, O_RDONLY);
+    bool opened = output.in >= 0;
+#else
+    output.in = fopen(filename, "rb");
+    bool opened = output.in != NULL;
+#endif
+    if (!opened) {
+        index_free(&index);
+        return split_fail(result, "Cannot open file %s", filename);
+    }
+    size_t path_size = strlen(prefix) + 32;
+    char *path = malloc(path_size);
+
+    SplitWalk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.index = &index;
+    walk.medium_map = UINT64_MAX;
+
+    // Parts never span documents; an unclosed document runs up to the next one
+    uint64_t prologue = index.documents[0].start;
+    size_t page = 0;
+    bool ok = path || split_fail(result, "Memory allocation failed");
+    for (size_t d = 0; ok && d < index.document_count; d++) {
+        uint64_t document = index.documents[d].start;
+        uint64_t document_end = index.documents[d].end ? index.documents[d].end
+                              : d + 1 < index.document_count ? index.documents[d + 1].start : file_size;
+        while (page < index.page_count && index.pages[page].start < document)
+            page++;
+        size_t first = page;
+        while (page < index.page_count && index.pages[page].start < document_end)
+            page++;
+        size_t last = page;
+
+        if (pages_per_part == 0 || first == last) {
+            snprintf(path, path_size, "%s%04zu.afp", prefix, result->parts + 1);
+            ok = split_part(&output, &walk, path, prologue, document, document, document, document_end);
+            continue;
+        }
+        // The first part of a document starts with its Begin Document, the
+        // last one ends with its End Document
+        uint64_t head_end = document_head_end(&index, document, index.pages[first].start);
+        for (size_t p = first; ok && p < last; p += pages_per_part) {
+            size_t q = last - p > pages_per_part ? p + pages_per_part : last;
+            uint64_t start = p == first ? document : index.pages[p].start;
+            uint64_t end = q == last ? document_end
+                         : index.pages[q - 1].end ? index.pages[q - 1].end : index.pages[q].start;
+            snprintf(path, path_size, "%s%04zu.afp", prefix, result->parts + 1);
+            ok = split_part(&output, &walk, path, prologue, document, head_end, start, end);
+        }
+    }
+
+#ifdef AFP_HAVE_FD
+    close(output.in);
+#else
+    fclose(output.in);
+#endif
+    free(output.buffer);
+    free(walk.open);
+    free(path);
+    index_free(&index);
+    return ok;
+}
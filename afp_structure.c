@@ -0,0 +1,140 @@
+// Begin/end pairing. Every Begin field (D3A8xx) opens a container that the
+// End field with the same last type byte (D3A9xx) closes, so the pairing
+// works for any container, known to the type table or not. Open containers
+// live on a growable stack with the offset and name of their begin field;
+// each field is checked against the container it appears in.
+#include "afp_internal.h"
+
+// Container classes, for the placement rules
+enum {
+    IN_TOP            = 1 << 0,  // Not inside any container
+    IN_PRINT_FILE     = 1 << 1,
+    IN_DOCUMENT       = 1 << 2,
+    IN_PAGE_GROUP     = 1 << 3,
+    IN_PAGE           = 1 << 4,
+    IN_OVERLAY        = 1 << 5,
+    IN_PAGE_SEGMENT   = 1 << 6,
+    IN_RESOURCE_GROUP = 1 << 7,
+    IN_RESOURCE       = 1 << 8,
+    IN_FORM_MAP       = 1 << 9,
+    IN_TEXT           = 1 << 10,
+    IN_IMAGE          = 1 << 11,
+    IN_IM_IMAGE       = 1 << 12,
+    IN_GRAPHICS       = 1 << 13,
+    IN_BAR_CODE       = 1 << 14,
+    IN_OBJECT_CONTAINER = 1 << 15,
+    IN_OTHER          = 1 << 16
+};
+
+#define IN_DATA_OBJECT (IN_TEXT | IN_IMAGE | IN_IM_IMAGE | IN_GRAPHICS | IN_BAR_CODE | IN_OBJECT_CONTAINER)
+#define IN_PRESENTATION (IN_TOP | IN_PAGE | IN_OVERLAY | IN_PAGE_SEGMENT | IN_RESOURCE)
+
+// Containers each field may appear in; 0 places no restriction
+static const uint32_t allowed_in[SF_TYPE_COUNT] = {
+    [SF_BPF] = IN_TOP,
+    [SF_BDT] = IN_TOP | IN_PRINT_FILE | IN_RESOURCE,
+    [SF_BNG] = IN_DOCUMENT | IN_PAGE_GROUP,
+    [SF_BPG] = IN_TOP | IN_DOCUMENT | IN_PAGE_GROUP | IN_RESOURCE,
+    [SF_BRG] = IN_TOP | IN_PRINT_FILE | IN_DOCUMENT | IN_PAGE_GROUP,
+    [SF_BRS] = IN_TOP | IN_RESOURCE_GROUP,
+    [SF_BMO] = IN_TOP | IN_RESOURCE_GROUP | IN_RESOURCE,
+    [SF_BPS] = IN_TOP | IN_RESOURCE_GROUP | IN_RESOURCE,
+    [SF_BFM] = IN_TOP | IN_RESOURCE_GROUP | IN_RESOURCE,
+    [SF_BMM] = IN_FORM_MAP | IN_DOCUMENT | IN_PAGE_GROUP,
+    [SF_BDG] = IN_FORM_MAP,
+    [SF_BAG] = IN_PAGE | IN_OVERLAY,
+    [SF_BOG] = IN_DATA_OBJECT,
+    [SF_BCF] = IN_TOP | IN_RESOURCE,
+    [SF_BFN] = IN_TOP | IN_RESOURCE,
+    [SF_BCP] = IN_TOP | IN_RESOURCE,
+    [SF_BPT] = IN_PRESENTATION,
+    [SF_BIM] = IN_PRESENTATION,
+    [SF_BII] = IN_PRESENTATION,
+    [SF_BGR] = IN_PRESENTATION,
+    [SF_BBC] = IN_PRESENTATION,
+    [SF_BOC] = IN_PRESENTATION,
+    // Object data; text may also sit directly on a page or overlay
+    [SF_PTX] = IN_TEXT | IN_PAGE | IN_OVERLAY,
+    [SF_IPD] = IN_IMAGE,
+    [SF_IRD] = IN_IM_IMAGE,
+    [SF_GAD] = IN_GRAPHICS,
+    [SF_BDA] = IN_BAR_CODE,
+    [SF_OCD] = IN_OBJECT_CONTAINER,
+};
+
+static uint32_t container_class(uint16_t code) {
+    switch (sf_type_index[code]) {
+        case SF_BPF: return IN_PRINT_FILE;
+        case SF_BDT: return IN_DOCUMENT;
+        case SF_BNG: return IN_PAGE_GROUP;
+        case SF_BPG: return IN_PAGE;
+        case SF_BMO: return IN_OVERLAY;
+        case SF_BPS: return IN_PAGE_SEGMENT;
+        case SF_BRG: return IN_RESOURCE_GROUP;
+        case SF_BRS: return IN_RESOURCE;
+        case SF_BFM: return IN_FORM_MAP;
+        case SF_BPT: return IN_TEXT;
+        case SF_BIM: return IN_IMAGE;
+        case SF_BII: return IN_IM_IMAGE;
+        case SF_BGR: return IN_GRAPHICS;
+        case SF_BBC: return IN_BAR_CODE;
+        case SF_BOC: return IN_OBJECT_CONTAINER;
+        default: return IN_OTHER;
+    }
+}
+
+// Type name of a D3xxxx field, or its hex code when the type is unknown
+void field_type_label(uint16_t code, char *label, size_t size) {
+    SFTypeId id = (SFTypeId)sf_type_index[code];
+    if (id != SF_UNKNOWN)
+        snprintf(label, size, "%s", sf_types[id].name);
+    else
+        snprintf(label, size, "D3%04X", code);
+}
+
+bool containers_push(ContainerStack *stack, uint16_t code, uint64_t offset, const char *name) {
+    if (!array_reserve((void **)&stack->items, &stack->capacity, stack->count + 1, sizeof(OpenContainer)))
+        return false;
+    OpenContainer *container = &stack->items[stack->count++];
+    container->code = code;
+    container->offset = offset;
+    memcpy(container->name, name, sizeof(container->name));
+    return true;
+}
+
+void containers_free(ContainerStack *stack) {
+    free(stack->items);
+    memset(stack, 0, sizeof(*stack));
+}
+
+// Whether the placement of a field is checked at all
+bool container_restricted(SFTypeId id) {
+    return allowed_in[id] != 0;
+}
+
+// Whether a field may appear in the innermost open container
+bool container_allows(const ContainerStack *stack, SFTypeId id) {
+    uint32_t allowed = allowed_in[id];
+    if (allowed == 0)
+        return true;
+    uint32_t here = stack->count == 0 ? IN_TOP : container_class(stack->items[stack->count - 1].code);
+    return (allowed & here) != 0;
+}
+
+// "Page PG000001 (opened at position 123)", with the type code for unknown types
+void container_label(const OpenContainer *container, const CodePage *codepage, char *label, size_t size) {
+    SFTypeId id = (SFTypeId)sf_type_index[container->code];
+    const char *type = sf_types[id].name;
+    char code[8];
+    char name[EBCDIC_NAME_SIZE];
+    if (id == SF_UNKNOWN) {
+        snprintf(code, sizeof(code), "D3%04X", container->code);
+        type = code;
+    } else if (strncmp(type, "Begin ", 6) == 0) {
+        type += 6;
+    }
+    ebcdic_name(codepage, (const unsigned char *)container->name, strlen(container->name), name);
+
+    snprintf(label, size, "%s%s%s (opened at position %llu)", type, name[0] ? " " : "", name,
+             (unsigned long long)container->offset);
+}
@@ -0,0 +1,198 @@
+// Presentation text extraction. Walks the PTOCA control sequences of the
+// Presentation Text Data fields of each page and writes their characters
+// as UTF-8: a line per baseline, a form feed after every page. Characters
+// and breaks are staged together, so a block of text takes one pass
+// through the vector conversion instead of one short pass per string; the
+// breaks are put in after it. Line feeds and form feeds in the text itself
+// are controls of the code page and come out as '.' like the others.
+#include "afp_internal.h"
+
+#define PTOCA_ESCAPE 0x2B // Followed by 0xD3, starts a chain of control sequences
+
+#define EBCDIC_BLANK 0x40
+
+// PTOCA function types, unchained; the chained form is one higher
+enum {
+    PTOCA_AMI = 0xC6, // Absolute Move Inline
+    PTOCA_RMI = 0xC8, // Relative Move Inline
+    PTOCA_AMB = 0xD2, // Absolute Move Baseline
+    PTOCA_RMB = 0xD4, // Relative Move Baseline
+    PTOCA_BLN = 0xD8, // Begin Line
+    PTOCA_TRN = 0xDA, // Transparent Data
+    PTOCA_RPS = 0xEE  // Repeat String
+};
+
+// Convert and write the staged text. A staged break holds its UTF-8
+// character, which replaces whatever the code page made of it.
+void text_flush(TextExtractor *text) {
+    if (text->staged == 0)
+        return;
+    unsigned char *p = text->utf8;
+    bool wide = ebcdic_convert(text->codepage->latin1, text->stage, p, text->staged);
+    for (size_t i = 0; i < text->break_count; i++)
+        p[text->breaks[i]] = text->stage[text->breaks[i]];
+    size_t length = wide ? latin1_to_utf8(p, text->staged) : text->staged;
+    writer_write(text->out, p, length);
+    text->staged = 0;
+    text->break_count = 0;
+}
+
+// Text from here on is in codepage
+static void text_codepage(TextExtractor *text, const CodePage *codepage) {
+    if (text->codepage == codepage)
+        return;
+    text_flush(text);
+    text->codepage = codepage;
+}
+
+static void text_stage(TextExtractor *text, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        if (text->staged == TEXT_STAGE_SIZE)
+            text_flush(text);
+        size_t count = TEXT_STAGE_SIZE - text->staged;
+        if (count > length)
+            count = length;
+        memcpy(text->stage + text->staged, data, count);
+        text->staged += count;
+        data += count;
+        length -= count;
+    }
+}
+
+static void text_byte(TextExtractor *text, unsigned char byte) {
+    if (text->staged == TEXT_STAGE_SIZE)
+        text_flush(text);
+    text->stage[text->staged++] = byte;
+}
+
+// A line or page break: '\n' or '\f', already UTF-8
+static void text_separator(TextExtractor *text, char separator) {
+    if (text->staged == TEXT_STAGE_SIZE || text->break_count == TEXT_BREAKS)
+        text_flush(text);
+    text->breaks[text->break_count++] = (uint16_t)text->staged;
+    text->stage[text->staged++] = (unsigned char)separator;
+}
+
+// End the current line, if anything was written on it
+static void text_break(TextExtractor *text) {
+    if (text->line_open)
+        text_separator(text, '\n');
+    text->line_open = false;
+    text->gap = false;
+}
+
+// Characters on the current line, a blank apart from the text before an
+// inline move
+static void text_chars(TextExtractor *text, const unsigned char *data, size_t length) {
+    if (length == 0)
+        return;
+    if (text->gap && text->line_open)
+        text_byte(text, EBCDIC_BLANK);
+    text->gap = false;
+    text->line_open = true;
+    text_stage(text, data, length);
+}
+
+static int16_t ptoca_int16(const unsigned char *p) {
+    return (int16_t)((p[0] << 8) | p[1]);
+}
+
+static void text_control(TextExtractor *text, unsigned char function, const unsigned char *params, size_t length) {
+    switch (function) {
+        case PTOCA_TRN:
+            text_chars(text, params, length);
+            break;
+        case PTOCA_RPS:
+            // Repeat length(2), then the data repeated up to that length
+            if (length > 2) {
+                size_t total = (size_t)((params[0] << 8) | params[1]);
+                while (total > 0) {
+                    size_t count = total < length - 2 ? total : length - 2;
+                    text_chars(text, params + 2, count);
+                    total -= count;
+                }
+            }
+            break;
+        case PTOCA_AMI:
+        case PTOCA_RMI:
+            text->gap = true;
+            break;
+        case PTOCA_AMB:
+            if (length >= 2) {
+                int32_t baseline = ptoca_int16(params);
+                if (baseline != text->baseline)
+                    text_break(text);
+                text->baseline = baseline;
+            }
+            break;
+        case PTOCA_RMB:
+            if (length >= 2 && ptoca_int16(params) != 0) {
+                text_break(text);
+                text->baseline += ptoca_int16(params);
+            }
+            break;
+        case PTOCA_BLN:
+            text_break(text);
+            break;
+        default:
+            break; // Fonts, rules, colors and orientation hold no text
+    }
+}
+
+// Characters run up to an escape sequence; the control sequences after it
+// form a chain while their function types are odd. Each sequence is its
+// length (counting the length and type bytes), its type and parameters.
+static void text_ptx(TextExtractor *text, const unsigned char *p, size_t length) {
+    const unsigned char *end = p + length;
+
+    while (p < end) {
+        const unsigned char *escape = p;
+        for (;;) {
+            escape = memchr(escape, PTOCA_ESCAPE, (size_t)(end - escape));
+            if (!escape || (escape + 1 < end && escape[1] == 0xD3))
+                break;
+            escape++;
+        }
+        text_chars(text, p, (size_t)((escape ? escape : end) - p));
+        if (!escape)
+            return;
+
+        p = escape + 2;
+        bool chained = true;
+        while (chained) {
+            if (end - p < 2 || p[0] < 2 || p[0] > end - p)
+                return; // Malformed chain: nothing after it can be trusted to be text
+            text_control(text, p[1] & 0xFE, p + 2, (size_t)p[0] - 2);
+            chained = (p[1] & 0x01) != 0;
+            p += p[0];
+        }
+    }
+}
+
+// Extract the text of a field. Only text inside pages is written;
+// overlays and page segments are resources, not page content.
+void text_field(TextExtractor *text, const CodePage *codepage, const StructuredField *field) {
+    switch (field->id) {
+        case SF_BPG:
+            text_codepage(text, codepage);
+            text->in_page = true;
+            text->line_open = false;
+            text->gap = false;
+            text->baseline = 0;
+            break;
+        case SF_EPG:
+            if (text->in_page) {
+                text_break(text);
+                text_separator(text, '\f');
+                text->in_page = false;
+            }
+            break;
+        case SF_PTX:
+            // Two reserved bytes precede the PTOCA data
+            if (text->in_page && field->data && field->length > 8)
+                text_ptx(text, field->data + 2, (size_t)field->length - 8);
+            break;
+        default:
+            break;
+    }
+}
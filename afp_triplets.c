@@ -0,0 +1,198 @@
+// Triplets: the self-describing parameters (length, id, data) carried in the
+// payload of many structured fields. They are decoded lazily, in place, one
+// at a time, and only for the fields a caller asks about.
+#include "afp_internal.h"
+
+static const char *const triplet_names[256] = {
+    [0x01] = "Coded Graphic Character Set Global ID",
+    [0x02] = "Fully Qualified Name",
+    [0x04] = "Mapping Option",
+    [0x10] = "Object Classification",
+    [0x18] = "MO:DCA Interchange Set",
+    [0x1F] = "Font Descriptor Specification",
+    [0x20] = "Font Coded Graphic Character Set Global ID",
+    [0x21] = "Resource Object Type",
+    [0x22] = "Extended Resource Local ID",
+    [0x24] = "Resource Local ID",
+    [0x25] = "Resource Section Number",
+    [0x26] = "Character Rotation",
+    [0x2D] = "Object Byte Offset",
+    [0x36] = "Attribute Value",
+    [0x43] = "Descriptor Position",
+    [0x45] = "Media Eject Control",
+    [0x46] = "Page Overlay Conditional Processing",
+    [0x47] = "Resource Usage Attribute",
+    [0x4B] = "Measurement Units",
+    [0x4C] = "Object Area Size",
+    [0x4D] = "Area Definition",
+    [0x4E] = "Color Specification",
+    [0x50] = "Encoding Scheme ID",
+    [0x56] = "Medium Map Page Number",
+    [0x57] = "Object Byte Extent",
+    [0x58] = "Object Structured Field Offset",
+    [0x59] = "Object Structured Field Extent",
+    [0x5A] = "Object Offset",
+    [0x5D] = "Font Horizontal Scale Factor",
+    [0x5E] = "Object Count",
+    [0x62] = "Local Date and Time Stamp",
+    [0x65] = "Comment",
+    [0x68] = "Medium Orientation",
+    [0x6C] = "Resource Object Include",
+    [0x70] = "Presentation Space Reset Mixing",
+    [0x71] = "Presentation Space Mixing Rules",
+    [0x72] = "Universal Date and Time Stamp",
+    [0x74] = "Toner Saver",
+    [0x75] = "Color Fidelity",
+    [0x78] = "Font Fidelity",
+    [0x80] = "Attribute Qualifier",
+    [0x81] = "Page Position Information",
+    [0x82] = "Parameter Value",
+    [0x83] = "Presentation Control",
+    [0x84] = "Font Resolution and Metric Technology",
+    [0x85] = "Finishing Operation",
+    [0x86] = "Text Fidelity",
+    [0x87] = "Media Fidelity",
+    [0x88] = "Finishing Fidelity",
+    [0x8B] = "Data-Object Font Descriptor",
+    [0x8C] = "Locale Selector",
+    [0x8E] = "UP3i Finishing Operation",
+    [0x91] = "Color Management Resource Descriptor",
+    [0x95] = "Rendering Intent",
+    [0x96] = "CMR Tag Fidelity",
+    [0x97] = "Device Appearance",
+    [0x9A] = "Image Resolution",
+    [0x9C] = "Object Container Presentation Space Size",
+};
+
+const char *get_triplet_name(unsigned char id) {
+    return triplet_names[id] ? triplet_names[id] : "Unknown";
+}
+
+// Where the triplets of a field start: a payload offset, TRIPLETS_GROUPED
+// for fields made of length-prefixed repeating groups, or TRIPLETS_NONE
+static int triplet_layout(SFTypeId id) {
+    switch (id) {
+        case SF_BDT: case SF_EDT:
+        case SF_BRS: case SF_ERS:
+            return 10; // Name(8), reserved(2)
+        case SF_IOB:
+            return 27; // Name, object type, origins, orientation, reference system
+        case SF_MCF: case SF_MPO: case SF_MDR:
+            return TRIPLETS_GROUPED;
+        default:
+            // Begin and end fields: optional name(8), then triplets
+            if (sf_types[id].kind != SF_KIND_OTHER)
+                return 8;
+            return TRIPLETS_NONE;
+    }
+}
+
+void triplets_init(TripletIterator *it, const unsigned char *data, size_t length, bool grouped) {
+    it->next = data;
+    it->end = data + length;
+    it->group_end = grouped ? data : it->end;
+    it->grouped = grouped;
+    it->malformed = false;
+}
+
+// Position an iterator on the triplets of a field. Returns false for fields
+// that carry none; nothing is decoded until triplet_next is called.
+bool triplets_of_field(TripletIterator *it, const StructuredField *field) {
+    int layout = triplet_layout(field->id);
+    size_t length = (size_t)field->length - 8; // Payload after the reserved bytes
+    const unsigned char *payload = field->data + 2;
+
+    if (layout == TRIPLETS_NONE)
+        return false;
+    if (layout == TRIPLETS_GROUPED) {
+        triplets_init(it, payload, length, true);
+        return true;
+    }
+    if ((size_t)layout >= length)
+        return false;
+    triplets_init(it, payload + layout, length - (size_t)layout, false);
+    return true;
+}
+
+// Next triplet, or false at the end of the data or at the first triplet
+// whose length does not fit (it->malformed is then set)
+bool triplet_next(TripletIterator *it, Triplet *triplet) {
+    // Repeating groups: 2-byte group length, then triplets
+    while (it->grouped && it->next == it->group_end) {
+        if (it->end - it->next < 2)
+            return false;
+        size_t group = (size_t)((it->next[0] << 8) | it->next[1]);
+        if (group < 2 || group > (size_t)(it->end - it->next)) {
+            it->malformed = true;
+            return false;
+        }
+        it->group_end = it->next + group;
+        it->next += 2;
+    }
+
+    size_t left = (size_t)(it->group_end - it->next);
+    if (left == 0)
+        return false;
+    size_t length = it->next[0];
+    if (length < 2 || length > left) {
+        it->malformed = true;
+        it->offset = it->next;
+        return false;
+    }
+
+    triplet->id = it->next[1];
+    triplet->length = (unsigned char)length;
+    triplet->data = it->next + 2;
+    triplet->data_length = length - 2;
+    it->offset = it->next;
+    it->next += length;
+    return true;
+}
+
+// Semantic checks of the triplets whose layout is fixed. Returns false and
+// describes the problem when a triplet is invalid.
+bool triplet_check(const Triplet *triplet, char *message, size_t size) {
+    const char *name = get_triplet_name(triplet->id);
+    switch (triplet->id) {
+        case 0x01: // GCSGID(2), CPGID(2), or CCSID form
+            if (triplet->length != 6)
+                break;
+            return true;
+        case 0x02: // FQN type, format, name
+            if (triplet->length < 5)
+                break;
+            if (triplet->data[1] != 0x00 && triplet->data[1] != 0x10 && triplet->data[1] != 0x20) {
+                snprintf(message, size, "Fully Qualified Name triplet with unknown format X'%02X'", triplet->data[1]);
+                return false;
+            }
+            return true;
+        case 0x10: // Reserved, class, reserved(2), structure, registered object id(16), ...
+            if (triplet->length < 0x20)
+                break;
+            return true;
+        case 0x18: // Interchange set type and identifier
+            if (triplet->length != 5)
+                break;
+            return true;
+        case 0x21: // Object type, reserved(7)
+            if (triplet->length != 10)
+                break;
+            return true;
+        case 0x24: // Resource type, local id
+            if (triplet->length != 4)
+                break;
+            return true;
+        case 0x4B: // X and Y units base, X and Y units per unit base
+            if (triplet->length != 8)
+                break;
+            return true;
+        case 0x50: // ESidCP, optional ESidUD
+            if (triplet->length != 4 && triplet->length != 6)
+                break;
+            return true;
+        default:
+            return true;
+    }
+    snprintf(message, size, "%s triplet (X'%02X') has invalid length %u", name, triplet->id, triplet->length);
+    return false;
+}
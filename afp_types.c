@@ -0,0 +1,57 @@
+// Structured field type table and names
+#include "afp_internal.h"
+
+const SFTypeInfo sf_types[SF_TYPE_COUNT] = {
+    [SF_UNKNOWN] = {0, "", "Unknown", COMPONENT_UNKNOWN, OBJ_UNKNOWN, SF_KIND_OTHER, 0},
+#define SF_INFO_ENTRY(id, code, acronym, name, component, obj_type, flags) \
+    [SF_##id] = {code, acronym, name, component, obj_type, SF_KIND_OF(code), flags},
+    SF_TYPE_LIST(SF_INFO_ENTRY)
+#undef SF_INFO_ENTRY
+};
+
+// Direct index from type bytes 1-2 to SFTypeId; unlisted codes stay SF_UNKNOWN
+const unsigned char sf_type_index[0x10000] = {
+#define SF_INDEX_ENTRY(id, code, acronym, name, component, obj_type, flags) [code] = SF_##id,
+    SF_TYPE_LIST(SF_INDEX_ENTRY)
+#undef SF_INDEX_ENTRY
+};
+
+// Function to identify field type
+void identify_field_type(StructuredField *field) {
+    field->id = sf_type_id(field->type);
+    field->component = sf_types[field->id].component;
+    field->obj_type = sf_types[field->id].obj_type;
+    
+    // Begin/End and include fields carry the object name after the reserved bytes
+    if ((sf_types[field->id].flags & SF_NAMED) && field->data && field->length >= 16) {
+        memcpy(field->name, field->data + 2, 8);
+        field->name[8] = '\0';
+    }
+}
+
+const char* get_component_name(AFPComponent component) {
+    switch(component) {
+        case COMPONENT_DOCUMENT: return "Document";
+        case COMPONENT_PAGE_GROUP: return "Page Group";
+        case COMPONENT_PAGE: return "Page";
+        case COMPONENT_OBJECT: return "Object";
+        case COMPONENT_RESOURCE_GROUP: return "Resource Group";
+        case COMPONENT_OVERLAY: return "Overlay";
+        case COMPONENT_RESOURCE: return "Resource";
+        default: return "Unknown";
+    }
+}
+
+const char* get_object_type_name(AFPObjectType type) {
+    switch(type) {
+        case OBJ_PRESENTATIONTEXT: return "Presentation Text";
+        case OBJ_IMAGE: return "Image";
+        case OBJ_GRAPHICS: return "Graphics";
+        case OBJ_BARCODE: return "Barcode";
+        case OBJ_FONT: return "Font";
+        case OBJ_PAGSEG: return "Page Segment";
+        case OBJ_FORMDEF: return "Form Definition";
+        case OBJ_RESLIB: return "Resource Library";
+        default: return "Unknown";
+    }
+}
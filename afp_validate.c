@@ -0,0 +1,1070 @@
+// Validation passes and the validator context
+#include "afp_internal.h"
+
+#include <stdarg.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Histogram bucket of a field size (9 to 65536 bytes)
+int length_bucket(size_t field_size) {
+    int width = 0;
+#if defined(__GNUC__)
+    width = 32 - __builtin_clz((unsigned int)field_size | 1);
+#else
+    while ((field_size >> width) != 0)
+        width++;
+#endif
+    int bucket = width - 4;
+    return bucket < 0 ? 0 : bucket >= LENGTH_BUCKETS ? LENGTH_BUCKETS - 1 : bucket;
+}
+
+void update_statistics(AFPStatistics *stats, const StructuredField *field, uint64_t position, size_t field_size) {
+    const SFTypeInfo *info = &sf_types[field->id];
+    FieldTypeStatistics *type = &stats->types[field->id];
+    type->count++;
+    type->bytes += field_size;
+    type->lengths[length_bucket(field_size)]++;
+    if (field_size > type->largest) {
+        type->largest = field_size;
+        type->largest_offset = position;
+    }
+    
+    if (field->id == SF_EPG && stats->page_open) {
+        PageSize page = {stats->pages, stats->page_start, position + field_size - stats->page_start};
+        statistics_add_page(stats, &page);
+        stats->page_open = false;
+    }
+    if (info->kind != SF_KIND_BEGIN)
+        return;
+    if (field->id == SF_BPG) {
+        stats->page_start = position;
+        stats->page_open = true;
+    }
+    
+    // Count containers at their Begin structured field
+    switch (field->id) {
+        case SF_BDT: stats->documents++; break;
+        case SF_BNG: stats->page_groups++; break;
+        case SF_BPG: stats->pages++; break;
+        case SF_BMO: stats->overlays++; break;
+        case SF_BRG: stats->resource_groups++; break;
+        case SF_BFM: stats->form_defs++; break;
+        case SF_BPS: stats->page_segments++; break;
+        default: break;
+    }
+    
+    // Count data objects and font resources
+    switch (info->obj_type) {
+        case OBJ_PRESENTATIONTEXT: stats->presentation_text++; break;
+        case OBJ_IMAGE: stats->images++; break;
+        case OBJ_GRAPHICS: stats->graphics++; break;
+        case OBJ_BARCODE: stats->barcodes++; break;
+        case OBJ_FONT: stats->fonts++; break;
+        default: break;
+    }
+}
+
+void state_init(ValidationState *state, AFPWriter *out, const ValidationOptions *options, uint64_t file_size) {
+    memset(state, 0, sizeof(*state));
+    state->out = out;
+    state->verbose = options->verbose;
+    state->dump_limit = options->dump_limit;
+    state->fingerprint = options->fingerprint;
+    state->deep = options->deep;
+    state->structure_only = options->structure_only && !options->verbose && !options->fingerprint &&
+                            !options->deep;
+    state->max_errors = options->max_errors;
+    state->codepage = codepage_find((unsigned)options->codepage);
+    state->codepage_fixed = state->codepage != NULL;
+    if (!state->codepage)
+        state->codepage = codepage_find(CODEPAGE_DEFAULT);
+    state->file_size = file_size;
+    state->is_valid = true;
+    state->perf = options->stats_perf;
+    if (state->perf) {
+        state->perf_threads = 1;
+        perf_snapshot(&state->perf_start);
+    }
+}
+
+void state_free(ValidationState *state) {
+    resources_free(&state->resources);
+    fingerprints_free(&state->fingerprints);
+    containers_free(&state->containers);
+    free(state->pending);
+    state->pending = NULL;
+    state->pending_count = state->pending_capacity = 0;
+}
+
+// Report an error as an "Error:" line of the text report and to the visitor
+static void state_error(ValidationState *state, uint64_t position, const char *format, ...) {
+    char message[256];
+    va_list args;
+    
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    
+    writer_printf(state->out, "Error: %s\n", message);
+    if (state->json_events) {
+        report_json_error(state, position, message);
+    }
+    if (state->visitor && state->visitor->on_error) {
+        state->visitor->on_error(state->user, position, message);
+    }
+}
+
+// Public view of a field for visitor callbacks
+static void visited_field(AFPField *visited, const StructuredField *field, uint64_t position) {
+    const SFTypeInfo *info = &sf_types[field->id];
+    
+    visited->offset = position;
+    visited->length = field->length;
+    memcpy(visited->type, field->type, 3);
+    visited->flags = field->flags;
+    visited->data = field->data;
+    visited->data_length = field->data ? (size_t)field->length - 6 : 0;
+    visited->acronym = info->acronym;
+    visited->type_name = info->name;
+}
+
+// Keep a field for the chunk merge. Returns false when it is not a chunk
+// field found with nothing open.
+static bool state_defer(ValidationState *state, uint16_t code, uint64_t position) {
+    if (!state->is_chunk || state->containers.count > 0)
+        return false;
+    if (!array_reserve((void **)&state->pending, &state->pending_capacity, state->pending_count + 1,
+                       sizeof(PendingField))) {
+        state_error(state, position, "Memory allocation failed");
+        state->is_valid = false;
+        return true;
+    }
+    PendingField *pending = &state->pending[state->pending_count++];
+    pending->code = code;
+    pending->position = position;
+    return true;
+}
+
+// Close the innermost container with an end field
+void state_close(ValidationState *state, uint16_t code, uint64_t position) {
+    ContainerStack *stack = &state->containers;
+    uint16_t begin = SF_BEGIN_CODE(code);
+    
+    if (state_defer(state, code, position))
+        return; // Opened in an earlier chunk; checked when the chunks are merged
+    if (stack->count > 0 && stack->items[stack->count - 1].code == begin) {
+        stack->count--;
+        return;
+    }
+    
+    char found[48];
+    char expected[96];
+    field_type_label(code, found, sizeof(found));
+    state_error(state, position, "Document structure mismatch at position %llu",
+                (unsigned long long)position);
+    if (stack->count == 0) {
+        writer_printf(state->out, "       Found %s with nothing open\n", found);
+    } else {
+        container_label(&stack->items[stack->count - 1], state->codepage, expected, sizeof(expected));
+        writer_printf(state->out, "       Expected to end %s but found %s\n", expected, found);
+    }
+    state->is_valid = false;
+    
+    // Only the innermost container is closed, so a chunk that found this end
+    // with something open decides exactly as a serial scan would
+    if (stack->count > 0)
+        stack->count--;
+}
+
+// Check that a field may appear in the innermost open container
+void state_place(ValidationState *state, uint16_t code, uint64_t position) {
+    SFTypeId id = (SFTypeId)sf_type_index[code];
+    if (!container_restricted(id) || state_defer(state, code, position))
+        return;
+    if (container_allows(&state->containers, id))
+        return;
+    
+    const ContainerStack *stack = &state->containers;
+    char label[96];
+    char where[112];
+    if (stack->count == 0) {
+        snprintf(where, sizeof(where), "outside any container");
+    } else {
+        container_label(&stack->items[stack->count - 1], state->codepage, label, sizeof(label));
+        snprintf(where, sizeof(where), "inside %s", label);
+    }
+    state_error(state, position, "%s at position %llu is not allowed %s", sf_types[id].name,
+                (unsigned long long)position, where);
+    state->is_valid = false;
+}
+
+// Count an error that invalidates the file. Returns false once the error
+// limit is reached.
+static bool state_count_error(ValidationState *state) {
+    state->error_count++;
+    state->is_valid = false;
+    if (state->max_errors > 0 && state->error_count >= (uint64_t)state->max_errors) {
+        writer_puts(state->out, "Too many errors, stopping analysis\n");
+        state->stopped = true;
+        return false;
+    }
+    return true;
+}
+
+// Deep validation: bounds and fixed lengths of the triplets of a field.
+// Returns false once the error limit is reached.
+static bool state_check_triplets(ValidationState *state, const StructuredField *field, uint64_t position) {
+    TripletIterator it;
+    Triplet triplet;
+    char message[160];
+    
+    if (!triplets_of_field(&it, field))
+        return true;
+    while (triplet_next(&it, &triplet)) {
+        if (!triplet_check(&triplet, message, sizeof(message))) {
+            uint64_t at = position + 7 + (uint64_t)(it.offset - field->data);
+            state_error(state, at, "%s at position %llu", message, (unsigned long long)at);
+            if (!state_count_error(state))
+                return false;
+        }
+    }
+    if (it.malformed) {
+        uint64_t at = position + 7 + (uint64_t)(it.offset - field->data);
+        state_error(state, at, "Malformed triplet in %s at position %llu - length runs past the field",
+                    sf_types[field->id].acronym, (unsigned long long)at);
+        return state_count_error(state);
+    }
+    return true;
+}
+
+// The first Begin Document names the code page of the names and text that
+// follow, unless the options chose one
+void state_document_codepage(ValidationState *state, const CodePage *codepage) {
+    state->document_seen = true;
+    state->document_codepage = codepage;
+    if (codepage && !state->codepage_fixed)
+        state->codepage = codepage;
+}
+
+// Code page named by the first Begin Document before limit, for passes
+// that start after it (parallel chunks, page ranges). Only the field
+// headers are walked, and only up to the first page. Moves the scanner.
+const CodePage *document_codepage(AFPScanner *scanner, uint64_t limit) {
+    if (!scanner_seek(scanner, 0))
+        return NULL;
+    while (scanner->position < limit) {
+        size_t avail;
+        const unsigned char *p = scanner_peek(scanner, 9, &avail);
+        uint16_t length = avail >= 3 ? (uint16_t)((p[1] << 8) | p[2]) : 0;
+        if (avail < 9 || p[0] != SF_INTRODUCER || length < 8 || scanner->position + 1 + length > limit) {
+            if (!scanner_resync(scanner))
+                return NULL;
+            continue;
+        }
+
+        SFTypeId id = sf_type_id(p + 3);
+        if (id == SF_BPG)
+            break;
+        if (id == SF_BDT) {
+            p = scanner_peek(scanner, 1 + (size_t)length, &avail);
+            if (avail < 1 + (size_t)length)
+                return NULL;
+            StructuredField field;
+            memset(&field, 0, sizeof(field));
+            field.length = length;
+            memcpy(field.type, p + 3, 3);
+            field.data = p + 7;
+            field.id = id;
+            return codepage_of_field(&field);
+        }
+        scanner_skip(scanner, 1 + (size_t)length);
+    }
+    return NULL;
+}
+
+// Resynchronize after a corrupt structured field, counting the whole corrupt
+// region as one error. Returns false once the error limit is reached.
+static bool state_recover(ValidationState *state, AFPScanner *scanner, uint64_t *position) {
+    uint64_t start = *position;
+    bool found = scanner_resync(scanner);
+    
+    *position = scanner->position;
+    state->skipped_bytes += *position - start;
+    writer_printf(state->out, "       Skipped %llu bytes (positions %llu-%llu) %s\n",
+            (unsigned long long)(*position - start), (unsigned long long)start,
+            (unsigned long long)(*position - 1), found ? "to the next structured field" : "to the end of input");
+    if (state->json_events) {
+        report_json_resync(state, start, *position - start, found);
+    }
+    return state_count_error(state);
+}
+
+// A file that is still growing may hold the rest of a corrupt region
+// later. Returns true, with the scanner where it was, when no field
+// follows the corrupt byte yet; the region is reported once it does.
+static bool state_wait_resync(ValidationState *state, AFPScanner *scanner) {
+    if (!state->growing)
+        return false;
+    uint64_t start = scanner->position;
+    bool found = scanner_resync(scanner);
+    scanner_seek(scanner, start);
+    if (found)
+        return false;
+    state->overran = true;
+    return true;
+}
+
+// Validate structured fields from the scanner position up to its size
+void scan_fields(ValidationState *state, AFPScanner *scanner) {
+    uint64_t position = scanner->position;
+    uint64_t limit = scanner->size;
+    
+    PERF_MARK(state);
+    while (scanner->streaming || position < limit) {
+        // Header: introducer(1) + length(2) + type(3) + flag(1)
+        size_t avail;
+        const unsigned char *buffer = scanner_peek(scanner, 7, &avail);
+
+        // Read introducer
+        if (avail < 1) {
+            if (!scanner->error) break;
+            state_error(state, position, "Failed to read introducer at position %llu",
+                        (unsigned long long)position);
+            state->is_valid = false;
+            break;
+        }
+        
+        if (buffer[0] != SF_INTRODUCER) {
+            if (state_wait_resync(state, scanner)) break;
+            state_error(state, position, "Invalid structured field introducer (0x%02X) at position %llu", 
+                   buffer[0], (unsigned long long)position);
+            bool resumed = state_recover(state, scanner, &position);
+            PERF_LAP(state, PERF_READ);
+            if (!resumed) break;
+            continue;
+        }
+        
+        // The rest of the header is still being written
+        if (avail < 7 && state->growing) {
+            state->overran = true;
+            break;
+        }
+        
+        // Read length (2 bytes)
+        if (avail < 3) {
+            state_error(state, position, "Failed to read length at position %llu",
+                        (unsigned long long)(position + 1));
+            state->is_valid = false;
+            break;
+        }
+        
+        uint16_t length = (buffer[1] << 8) | buffer[2];
+        
+        // Validate length: it covers at least length(2), type(3), flag(1) and reserved(2)
+        if (length < 8) {
+            if (state_wait_resync(state, scanner)) break;
+            state_error(state, position, "Invalid length (%d) at position %llu - too short", length,
+                        (unsigned long long)(position + 1));
+            bool resumed = state_recover(state, scanner, &position);
+            PERF_LAP(state, PERF_READ);
+            if (!resumed) break;
+            continue;
+        }
+        
+        // The length covers everything after the introducer. Streams have
+        // no known size; a truncated last field is caught when it is read.
+        if (!scanner->streaming && position + 1 + length > limit) {
+            if (limit < state->file_size || state->growing) {
+                // Chunk boundary was not on the field chain after all, or
+                // the field is still being written
+                state->overran = true;
+                break;
+            }
+            state_error(state, position, "Invalid length (%d) at position %llu - exceeds file size", 
+                   length, (unsigned long long)(position + 1));
+            bool resumed = state_recover(state, scanner, &position);
+            PERF_LAP(state, PERF_READ);
+            if (!resumed) break;
+            continue;
+        }
+        
+        // Read type (3 bytes)
+        if (avail < 6) {
+            state_error(state, position, "Failed to read type at position %llu",
+                        (unsigned long long)(position + 3));
+            state->is_valid = false;
+            break;
+        }
+        
+        // Read flag byte
+        if (avail < 7) {
+            state_error(state, position, "Failed to read flag byte at position %llu",
+                        (unsigned long long)(position + 6));
+            state->is_valid = false;
+            break;
+        }
+        
+        // Map the whole field; data is used in place. Structure-only runs
+        // step over the payloads that hold no name or resource reference;
+        // their size was checked above. Streams still read every payload to
+        // catch a truncated last field.
+        int data_length = length - 6; // Introducer(1) + length(2) + type(3) + flag(1) - 1
+        size_t field_size = 1 + (size_t)length;
+        SFTypeId id = sf_type_id(buffer + 3);
+        bool payload = !state->structure_only || scanner->streaming ||
+                       (sf_types[id].flags & (SF_NAMED | SF_REFERENCES)) || (state->text.out && id == SF_PTX);
+        size_t wanted = payload ? field_size : 7;
+        
+        buffer = scanner_peek(scanner, wanted, &avail);
+        if (avail < wanted) {
+            state_error(state, position, "Failed to read data at position %llu",
+                        (unsigned long long)(position + 7));
+            state->is_valid = false;
+            break;
+        }
+        
+        const unsigned char *type = buffer + 3;
+        unsigned char flag = buffer[6];
+        const unsigned char *data = payload ? buffer + 7 : NULL;
+        PERF_LAP(state, PERF_READ);
+        
+        // Prepare structured field
+        StructuredField field;
+        field.length = length;
+        memcpy(field.type, type, 3);
+        field.flags = flag;
+        field.data = data;
+        memset(field.name, 0, sizeof(field.name));
+        
+        // Identify field type and component
+        identify_field_type(&field);
+        PERF_LAP(state, PERF_DECODE);
+        
+        if (state->index) {
+            index_add_field(state->index, position, &field, field_size);
+        }
+        
+        AFPField visited;
+        if (state->visitor) {
+            visited_field(&visited, &field, position);
+            if (state->visitor->on_field) {
+                state->visitor->on_field(state->user, &visited);
+            }
+            if (state->visitor->on_begin && sf_types[field.id].kind == SF_KIND_BEGIN) {
+                state->visitor->on_begin(state->user, &visited, (int)state->containers.count);
+            }
+        }
+        
+        // Pair every begin field with its end field and check where each field appears
+        uint16_t code = (uint16_t)((type[1] << 8) | type[2]);
+        if (type[0] == 0xD3) {
+            state_place(state, code, position);
+            if (type[1] == 0xA8) {
+                if (!containers_push(&state->containers, code, position, field.name)) {
+                    state_error(state, position, "Memory allocation failed");
+                    state->is_valid = false;
+                }
+            } else if (type[1] == 0xA9) {
+                state_close(state, code, position);
+            }
+        }
+        
+        switch (field.id) {
+            case SF_BDT:
+                state->has_begin_document = true;
+                if (!state->document_seen)
+                    state_document_codepage(state, codepage_of_field(&field));
+                break;
+            case SF_EDT:
+                state->has_end_document = true;
+                break;
+            case SF_BPG:
+                state->page_count++;
+                break;
+            case SF_BAG:
+                state->object_count++;
+                break;
+            default:
+                break;
+        }
+        
+        if (state->visitor && state->visitor->on_end && sf_types[field.id].kind == SF_KIND_END) {
+            state->visitor->on_end(state->user, &visited, (int)state->containers.count);
+        }
+        
+        // Count inline resources
+        if (field.id == SF_BRS) {
+            state->resource_count++;
+        }
+        resources_collect(&state->resources, &field, position);
+        if (state->fingerprint) {
+            fingerprint_field(&state->span, &state->fingerprints, &field, buffer, field_size, position);
+        }
+        bool stop = state->deep && !state_check_triplets(state, &field, position);
+        
+        // Update statistics
+        update_statistics(&state->stats, &field, position, field_size);
+        
+        PERF_LAP(state, PERF_VALIDATE);
+        
+        if (state->text.out) {
+            text_field(&state->text, state->codepage, &field);
+        }
+        if (state->json_fields) {
+            report_json_field(state, &field, position);
+        }
+        
+        // Print field information
+        if (state->verbose) {
+            writer_printf(state->out, "Field #%llu at position %llu:\n",
+                          (unsigned long long)state->field_count + 1, (unsigned long long)position);
+            writer_puts(state->out, "  Introducer: 0x5A\n");
+            writer_printf(state->out, "  Length: %d\n", length);
+            writer_printf(state->out, "  Flag: 0x%02X\n", flag);
+            writer_puts(state->out, "  ");
+            print_ebcdic_type(state->out, type);
+            
+            if (field.component != COMPONENT_UNKNOWN) {
+                writer_printf(state->out, "  Component: %s\n", get_component_name(field.component));
+            }
+            
+            if (field.obj_type != OBJ_UNKNOWN) {
+                writer_printf(state->out, "  Object Type: %s\n", get_object_type_name(field.obj_type));
+            }
+            
+            if (field.name[0] != 0) {
+                writer_printf(state->out, "  %s Name: ", field.id == SF_BDT ? "Document" : "Resource");
+                print_ebcdic_string(state->out, state->codepage, (unsigned char*)field.name, strlen(field.name));
+            }
+            
+            TripletIterator triplets;
+            if (triplets_of_field(&triplets, &field)) {
+                print_triplets(state->out, &triplets, state->codepage);
+            }
+            
+            writer_puts(state->out, "  Data: ");
+            if (data_length > 0) {
+                size_t shown = (size_t)data_length;
+                if (state->dump_limit > 0 && shown > state->dump_limit) {
+                    shown = state->dump_limit;
+                }
+                print_hex(state->out, data, shown);
+                if (shown < (size_t)data_length) {
+                    writer_printf(state->out, "        (%zu of %d bytes shown)\n", shown, data_length);
+                }
+            } else {
+                writer_puts(state->out, "(none)\n");
+            }
+            writer_puts(state->out, "\n");
+        }
+        
+        PERF_LAP(state, PERF_PRINT);
+        
+        state->field_count++;
+        position += field_size;
+        scanner_skip(scanner, field_size);
+        if (stop) break;
+        if (state->checkpoint && position >= state->checkpoint->next) {
+            checkpoint_write(state->checkpoint, state, position);
+        }
+    }
+    if (state->text.out) {
+        text_flush(&state->text);
+    }
+}
+
+struct AFPValidator {
+    ValidationOptions options;
+    FILE *out;          // Text report, NULL for none
+    FILE *text;         // Extracted page text, NULL for none
+    AFPVisitor visitor;
+    void *user;
+    FingerprintList *fingerprints; // Receives the fingerprints of a run (batch)
+    PerfCounters perf_start;       // Thread counters before the input was opened
+};
+
+AFPValidator *afp_validator_create(const ValidationOptions *options) {
+    AFPValidator *validator = calloc(1, sizeof(*validator));
+    if (!validator)
+        return NULL;
+    if (options)
+        validator->options = *options;
+    else
+        validator->options.threads = 1;
+    return validator;
+}
+
+void afp_validator_destroy(AFPValidator *validator) {
+    free(validator);
+}
+
+void afp_validator_set_output(AFPValidator *validator, FILE *out) {
+    validator->out = out;
+}
+
+void afp_validator_set_text_output(AFPValidator *validator, FILE *text) {
+    validator->text = text;
+}
+
+void afp_validator_set_visitor(AFPValidator *validator, const AFPVisitor *visitor, void *user) {
+    if (visitor)
+        validator->visitor = *visitor;
+    else
+        memset(&validator->visitor, 0, sizeof(validator->visitor));
+    validator->user = user;
+}
+
+static bool validator_has_visitor(const AFPValidator *validator) {
+    const AFPVisitor *visitor = &validator->visitor;
+    return visitor->on_field || visitor->on_begin || visitor->on_end || visitor->on_error;
+}
+
+static void state_result(ValidationState *state, ValidationResult *result) {
+    if (result) {
+        result->opened = true;
+        result->is_valid = state->is_valid;
+        result->field_count = state->field_count;
+        result->error_count = state->error_count;
+        result->file_size = state->file_size;
+    }
+}
+
+// Summary of a finished run, with the performance counters of every
+// thread that took part when they were asked for
+static void state_report(ValidationState *state) {
+    PERF_MARK(state);
+    print_validation_summary(state);
+    PERF_LAP(state, PERF_PRINT);
+    if (state->perf) {
+        perf_since(&state->perf_counters, &state->perf_start);
+        print_perf_summary(state);
+    }
+    if (state->json) {
+        report_json_summary(state);
+    }
+}
+
+// Report writers of one run. In the JSON formats the text report is
+// discarded and the JSON goes to the output stream.
+typedef struct {
+    AFPWriter text;
+    AFPWriter json;
+    AFPWriter extract; // Page text
+    const char *source;
+} RunOutput;
+
+static void run_output_init(RunOutput *output, AFPValidator *validator, const char *source) {
+    bool text = validator->options.format == AFP_REPORT_TEXT;
+    writer_init(&output->text, text ? validator->out : NULL);
+    writer_init(&output->json, text ? NULL : validator->out);
+    writer_init(&output->extract, validator->text);
+    output->source = source;
+}
+
+// Report in JSON that the input could not be validated (the text report
+// has its own message) and finish the run
+static bool run_output_fail(RunOutput *output, const char *message) {
+    if (output->json.file)
+        report_json_failure(&output->json, output->source, message);
+    writer_flush(&output->text);
+    writer_flush(&output->json);
+    writer_flush(&output->extract);
+    return false;
+}
+
+static void run_output_finish(RunOutput *output) {
+    writer_flush(&output->text);
+    writer_flush(&output->json);
+    writer_flush(&output->extract);
+}
+
+// Hand everything reported so far to the streams, while following a file
+static void run_output_push(RunOutput *output) {
+    AFPWriter *writers[] = {&output->text, &output->json, &output->extract};
+    for (size_t i = 0; i < sizeof(writers) / sizeof(writers[0]); i++) {
+        writer_flush(writers[i]);
+        if (writers[i]->file)
+            fflush(writers[i]->file);
+    }
+}
+
+static void validator_state_init(AFPValidator *validator, ValidationState *state, RunOutput *output,
+                                 uint64_t file_size) {
+    const ValidationOptions *options = &validator->options;
+    state_init(state, &output->text, options, file_size);
+    state->source = output->source;
+    if (state->perf) {
+        state->perf_start = validator->perf_start; // Count opening the input too
+    }
+    if (output->json.file) {
+        state->json = &output->json;
+        state->json_events = options->format == AFP_REPORT_JSONL;
+        state->json_fields = state->json_events && options->verbose;
+        state->verbose = false;
+    }
+    if (validator->text) {
+        // Read the text payloads and those the structure checks need
+        state->text.out = &output->extract;
+        state->structure_only = !options->verbose && !options->fingerprint && !options->deep;
+    }
+    if (validator_has_visitor(validator)) {
+        state->visitor = &validator->visitor;
+        state->user = validator->user;
+    }
+}
+
+// Validate everything the scanner holds. filename locates the sidecar
+// index; it is NULL for caller buffers, which are never indexed.
+static bool validator_scan(AFPValidator *validator, AFPScanner *scanner, const char *filename, RunOutput *output,
+                           ValidationResult *result) {
+    const ValidationOptions *options = &validator->options;
+    AFPWriter *out = &output->text;
+    ValidationState state;
+    validator_state_init(validator, &state, output, scanner->size);
+    bool visited = state.visitor != NULL;
+    if (state.structure_only) {
+        scanner_sparse(scanner);
+    }
+    
+    // The sidecar index only applies to regular files
+    AFPIndex index;
+    FileIdentity identity;
+    char *sidecar = NULL;
+    if (filename && options->index && !scanner->streaming && file_identity(filename, &identity)) {
+        sidecar = index_path(filename);
+    }
+    
+    // The index and checkpoints hold no fingerprints or text
+    bool extract = state.text.out != NULL;
+    Checkpoint checkpoint;
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    if (filename && (options->checkpoint_bytes > 0 || options->resume) && !scanner->streaming &&
+        !options->fingerprint && !extract && file_identity(filename, &checkpoint.identity)) {
+        checkpoint.path = sidecar_path(filename, ".afpckpt");
+    }
+    
+    if (sidecar && !options->verbose && !visited && !options->fingerprint && !extract && index_read(sidecar, &identity, &state, NULL)) {
+        writer_printf(out, "Summary loaded from index %s (run without -i for error details)\n", sidecar);
+    } else {
+        // A resumed pass has not seen the fields before the checkpoint, so it builds no index
+        uint64_t position;
+        bool resumed = false;
+        if (checkpoint.path && options->resume) {
+            resumed = checkpoint_read(&checkpoint, &state, &position) && scanner_seek(scanner, position);
+            if (resumed)
+                writer_printf(out, "Resuming at position %llu from checkpoint %s\n", (unsigned long long)position,
+                              checkpoint.path);
+            else
+                writer_printf(out,
+                              "Checkpoint %s is missing or does not match this run, validating from the start\n",
+                              checkpoint.path);
+        }
+        if (sidecar && !resumed) {
+            memset(&index, 0, sizeof(index));
+            state.index = &index;
+        }
+        if (checkpoint.path && options->checkpoint_bytes > 0) {
+            checkpoint.interval = options->checkpoint_bytes;
+            checkpoint.next = scanner->position + checkpoint.interval;
+            state.checkpoint = &checkpoint;
+        }
+        
+        // Verbose dumps, callbacks, text and checkpoints see fields in file order, and an
+        // error limit stops at one field of that order, so they stay serial
+        if (options->verbose || visited || extract || resumed || state.checkpoint || options->max_errors > 0 ||
+            !validate_parallel(&state, scanner, options->threads)) {
+            scan_fields(&state, scanner);
+        }
+        
+        // A scan that reached the end of the input no longer needs its
+        // checkpoint; one cut short by the error limit or a read error can
+        // still be resumed
+        if (checkpoint.failed)
+            writer_printf(out, "Warning: Cannot write checkpoint %s\n", checkpoint.path);
+        bool complete = !state.stopped && !scanner->error && scanner->position >= scanner->size;
+        if ((state.checkpoint || resumed) && complete)
+            remove(checkpoint.path);
+        state.checkpoint = NULL;
+        
+        // The summary of a scan cut short is not the one of the file, so
+        // it is not indexed
+        if (state.index) {
+            if (complete) {
+                if (index_write(sidecar, &identity, &state, &index))
+                    writer_printf(out, "Index written to %s\n", sidecar);
+                else
+                    writer_printf(out, "Warning: Cannot write index %s\n", sidecar);
+            }
+            index_free(&index);
+            state.index = NULL;
+        }
+    }
+    free(sidecar);
+    free(checkpoint.path);
+    
+    state_report(&state);
+    state_result(&state, result);
+    if (validator->fingerprints) {
+        *validator->fingerprints = state.fingerprints;
+        memset(&state.fingerprints, 0, sizeof(state.fingerprints));
+    }
+    state_free(&state);
+    return state.is_valid;
+}
+
+bool afp_validator_run(AFPValidator *validator, const char *filename, ValidationResult *result) {
+    if (result)
+        memset(result, 0, sizeof(*result));
+    bool is_stdin = strcmp(filename, "-") == 0;
+    if (validator->options.stats_perf)
+        perf_snapshot(&validator->perf_start);
+    RunOutput output;
+    run_output_init(&output, validator, is_stdin ? "(stdin)" : filename);
+    AFPWriter *out = &output.text;
+    
+    AFPScanner scanner;
+    if (!scanner_open(&scanner, filename)) {
+        writer_printf(out, "Error: Cannot open file %s\n", filename);
+        return run_output_fail(&output, "Cannot open file");
+    }
+    
+    if (scanner.streaming)
+        writer_printf(out, "\n\nAnalyzing AFP stream: %s\n\n", output.source);
+    else
+        writer_printf(out, "\n\nAnalyzing AFP file: %s (Size: %llu bytes)\n\n", filename,
+                      (unsigned long long)scanner.size);
+    
+    bool valid = validator_scan(validator, &scanner, filename, &output, result);
+    scanner_close(&scanner);
+    run_output_finish(&output);
+    return valid;
+}
+
+bool afp_validator_run_buffer(AFPValidator *validator, const unsigned char *data, size_t size,
+                              ValidationResult *result) {
+    if (result)
+        memset(result, 0, sizeof(*result));
+    if (validator->options.stats_perf)
+        perf_snapshot(&validator->perf_start);
+    RunOutput output;
+    run_output_init(&output, validator, "(buffer)");
+    
+    AFPScanner scanner;
+    scanner_open_buffer(&scanner, data, size);
+    writer_printf(&output.text, "\n\nAnalyzing AFP buffer (Size: %llu bytes)\n\n",
+                  (unsigned long long)scanner.size);
+    
+    bool valid = validator_scan(validator, &scanner, NULL, &output, result);
+    scanner_close(&scanner);
+    run_output_finish(&output);
+    return valid;
+}
+
+bool afp_validator_run_pages(AFPValidator *validator, const char *filename, uint32_t first, uint32_t last,
+                             ValidationResult *result) {
+    if (result)
+        memset(result, 0, sizeof(*result));
+    if (validator->options.stats_perf)
+        perf_snapshot(&validator->perf_start);
+    RunOutput output;
+    run_output_init(&output, validator, filename);
+    AFPWriter *out = &output.text;
+    
+    AFPScanner scanner;
+    if (!scanner_open(&scanner, filename)) {
+        writer_printf(out, "Error: Cannot open file %s\n", filename);
+        return run_output_fail(&output, "Cannot open file");
+    }
+    if (scanner.streaming) {
+        writer_printf(out, "Error: Page selection needs a seekable file, not a stream\n");
+        scanner_close(&scanner);
+        return run_output_fail(&output, "Page selection needs a seekable file, not a stream");
+    }
+    
+    AFPIndex index;
+    bool from_index;
+    uint64_t start, end;
+    bool found = load_page_table(filename, &scanner, validator->options.index, &index, &from_index);
+    if (!found) {
+        writer_printf(out, "Error: Cannot build the page table of %s\n", filename);
+    } else if (!(found = page_range(&index, scanner.size, first, last, &start, &end))) {
+        writer_printf(out, "Error: Pages %u-%u not found, %s has %zu pages\n", first, last, filename,
+                      index.page_count);
+    }
+    index_free(&index);
+    if (!found) {
+        scanner_close(&scanner);
+        return run_output_fail(&output, "Page range not found");
+    }
+    
+    uint64_t file_size = scanner.size;
+    writer_printf(out, "\n\nAnalyzing pages %u-%u of AFP file: %s (Size: %llu bytes)\n", first, last, filename,
+                  (unsigned long long)file_size);
+    writer_printf(out, "Page range: bytes %llu-%llu, located %s\n\n", (unsigned long long)start,
+                  (unsigned long long)end, from_index ? "with the index" : "by a header scan");
+    
+    ValidationState state;
+    validator_state_init(validator, &state, &output, file_size);
+    state.partial = true;
+    state.is_chunk = true; // Ends of containers begun before the range are expected
+    if (!state.codepage_fixed)
+        state_document_codepage(&state, document_codepage(&scanner, start));
+    
+    if (scanner_seek(&scanner, start)) {
+        scanner.size = end; // Stop at the end of the last selected page
+        scan_fields(&state, &scanner);
+        scanner.size = file_size;
+        if (state.overran) {
+            state_error(&state, end, "Structured field crosses the end of the page range at %llu",
+                        (unsigned long long)end);
+            state.is_valid = false;
+            state.error_count++;
+        }
+        
+        // Nesting across the range bounds is only known to a full scan
+        state.pending_count = 0;
+        state.containers.count = 0;
+    } else {
+        state_error(&state, start, "Cannot seek to position %llu", (unsigned long long)start);
+        state.is_valid = false;
+    }
+    scanner_close(&scanner);
+    
+    state_report(&state);
+    state_result(&state, result);
+    state_free(&state);
+    run_output_finish(&output);
+    return state.is_valid;
+}
+
+// Follow mode polls the size of the file this often
+#define FOLLOW_POLL_MS 250
+
+static void sleep_ms(unsigned ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec delay = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000L};
+    nanosleep(&delay, NULL);
+#endif
+}
+
+// Wait until the size of filename is no longer size. Returns false when
+// it stayed the same for idle_seconds.
+static bool follow_wait(const char *filename, uint64_t size, unsigned idle_seconds) {
+    for (uint64_t waited = 0; waited < (uint64_t)idle_seconds * 1000; waited += FOLLOW_POLL_MS) {
+        sleep_ms(FOLLOW_POLL_MS);
+        struct stat st;
+        if (stat(filename, &st) == 0 && (uint64_t)st.st_size != size)
+            return true;
+    }
+    return false;
+}
+
+bool afp_validator_follow(AFPValidator *validator, const char *filename, unsigned idle_seconds,
+                          ValidationResult *result) {
+    if (result)
+        memset(result, 0, sizeof(*result));
+    if (validator->options.stats_perf)
+        perf_snapshot(&validator->perf_start);
+    RunOutput output;
+    run_output_init(&output, validator, filename);
+    AFPWriter *out = &output.text;
+    
+    struct stat st;
+    if (strcmp(filename, "-") == 0 || stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) {
+        writer_printf(out, "Error: Following needs a regular file: %s\n", filename);
+        return run_output_fail(&output, "Following needs a regular file");
+    }
+    AFPScanner scanner;
+    if (!scanner_open(&scanner, filename)) {
+        writer_printf(out, "Error: Cannot open file %s\n", filename);
+        return run_output_fail(&output, "Cannot open file");
+    }
+    writer_printf(out, "\n\nFollowing AFP file: %s (Size: %llu bytes, done after %u seconds without growth)\n\n",
+                  filename, (unsigned long long)scanner.size, idle_seconds);
+    
+    // The state is the checkpoint: every pass resumes it at the first field
+    // the previous pass could not finish, so each pass reads only new bytes
+    ValidationState state;
+    validator_state_init(validator, &state, &output, scanner.size);
+    if (state.structure_only) {
+        scanner_sparse(&scanner);
+    }
+    bool growing = true;
+    for (;;) {
+        uint64_t start = scanner.position;
+        uint64_t fields = state.field_count;
+        state.growing = growing;
+        state.overran = false;
+        state.file_size = scanner.size;
+        scan_fields(&state, &scanner);
+        uint64_t position = scanner.position;
+        uint64_t size = scanner.size;
+        scanner_close(&scanner);
+        if (growing && position > start) {
+            writer_printf(out, "Checked %llu new fields, up to position %llu of %llu bytes\n",
+                          (unsigned long long)(state.field_count - fields), (unsigned long long)position,
+                          (unsigned long long)size);
+        }
+        run_output_push(&output);
+        if (!growing || state.stopped)
+            break;
+        
+        // Once the file stops growing, a last pass reports what is incomplete
+        growing = follow_wait(filename, size, idle_seconds);
+        if (!scanner_open(&scanner, filename)) {
+            state_error(&state, position, "Cannot reopen file %s", filename);
+            state.is_valid = false;
+            break;
+        }
+        if (scanner.size < position || !scanner_seek(&scanner, position)) {
+            state_error(&state, position, "File shrank to %llu bytes, before the checked position %llu",
+                        (unsigned long long)scanner.size, (unsigned long long)position);
+            state.is_valid = false;
+            scanner_close(&scanner);
+            break;
+        }
+        if (state.structure_only) {
+            scanner_sparse(&scanner);
+        }
+    }
+    
+    state_report(&state);
+    state_result(&state, result);
+    state_free(&state);
+    run_output_finish(&output);
+    return state.is_valid;
+}
+
+bool validate_afp_file(const char *filename, const ValidationOptions *options, FILE *out, ValidationResult *result) {
+    AFPValidator validator;
+    memset(&validator, 0, sizeof(validator));
+    validator.options = *options;
+    validator.out = out;
+    return afp_validator_run(&validator, filename, result);
+}
+
+// validate_afp_file, handing over the fingerprints of the inline resources
+bool validate_file_fingerprints(const char *filename, const ValidationOptions *options, FILE *out,
+                                ValidationResult *result, FingerprintList *fingerprints) {
+    AFPValidator validator;
+    memset(&validator, 0, sizeof(validator));
+    validator.options = *options;
+    validator.out = out;
+    validator.fingerprints = fingerprints;
+    return afp_validator_run(&validator, filename, result);
+}
+
+bool validate_pages(const char *filename, const ValidationOptions *options, uint32_t first, uint32_t last,
+                    FILE *out, ValidationResult *result) {
+    AFPValidator validator;
+    memset(&validator, 0, sizeof(validator));
+    validator.options = *options;
+    validator.out = out;
+    return afp_validator_run_pages(&validator, filename, first, last, result);
+}
@@ -0,0 +1,125 @@
+// Buffered report writer. Text is collected in a fixed buffer and handed to
+// the stream with large fwrite calls; hex and EBCDIC dumps are formatted
+// with lookup tables instead of one stdio call per byte.
+#include "afp_internal.h"
+
+#include <stdarg.h>
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+void writer_init(AFPWriter *writer, FILE *file) {
+    writer->file = file;
+    writer->length = 0;
+    writer->error = false;
+}
+
+void writer_flush(AFPWriter *writer) {
+    if (writer->file && writer->length > 0 &&
+        fwrite(writer->buffer, 1, writer->length, writer->file) != writer->length)
+        writer->error = true;
+    writer->length = 0;
+}
+
+// Room for at least want more bytes (want <= WRITER_BUFFER_SIZE)
+static inline char *writer_reserve(AFPWriter *writer, size_t want) {
+    if (WRITER_BUFFER_SIZE - writer->length < want)
+        writer_flush(writer);
+    return writer->buffer + writer->length;
+}
+
+void writer_write(AFPWriter *writer, const void *data, size_t length) {
+    if (!writer->file)
+        return;
+    if (length > WRITER_BUFFER_SIZE / 2) {
+        // Large blocks go straight to the stream
+        writer_flush(writer);
+        if (fwrite(data, 1, length, writer->file) != length)
+            writer->error = true;
+        return;
+    }
+    memcpy(writer_reserve(writer, length), data, length);
+    writer->length += length;
+}
+
+void writer_puts(AFPWriter *writer, const char *text) {
+    writer_write(writer, text, strlen(text));
+}
+
+void writer_printf(AFPWriter *writer, const char *format, ...) {
+    if (!writer->file)
+        return;
+
+    va_list args;
+    size_t room = WRITER_BUFFER_SIZE - writer->length;
+    va_start(args, format);
+    int length = vsnprintf(writer->buffer + writer->length, room, format, args);
+    va_end(args);
+    if (length < 0)
+        return;
+
+    if ((size_t)length >= room) {
+        // Did not fit: flush and format again, or bypass the buffer for huge text
+        writer_flush(writer);
+        va_start(args, format);
+        if ((size_t)length < WRITER_BUFFER_SIZE)
+            vsnprintf(writer->buffer, WRITER_BUFFER_SIZE, format, args);
+        else if (vfprintf(writer->file, format, args) < 0)
+            writer->error = true;
+        va_end(args);
+        if ((size_t)length >= WRITER_BUFFER_SIZE)
+            return;
+    }
+    writer->length += (size_t)length;
+}
+
+// Unsigned decimal number
+void writer_uint(AFPWriter *writer, uint64_t value) {
+    char digits[20];
+    size_t count = 0;
+
+    do {
+        digits[sizeof(digits) - ++count] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    writer_write(writer, digits + sizeof(digits) - count, count);
+}
+
+// Hex bytes, 16 per line, continuation lines indented under the first
+void writer_hex(AFPWriter *writer, const unsigned char *data, size_t length) {
+    static const char indent[] = "\n         ";
+    if (!writer->file)
+        return;
+
+    for (size_t i = 0; i < length; i += 16) {
+        size_t count = length - i < 16 ? length - i : 16;
+        char *p = writer_reserve(writer, 16 * 3 + sizeof(indent));
+        char *start = p;
+
+        for (size_t j = 0; j < count; j++) {
+            unsigned char byte = data[i + j];
+            *p++ = hex_digits[byte >> 4];
+            *p++ = hex_digits[byte & 0x0F];
+            *p++ = ' ';
+        }
+        if (i + count < length) {
+            memcpy(p, indent, sizeof(indent) - 1);
+            p += sizeof(indent) - 1;
+        }
+        writer->length += (size_t)(p - start);
+    }
+    writer_write(writer, "\n", 1);
+}
+
+// EBCDIC bytes as UTF-8 text, unprintable ones as '.'
+void writer_ebcdic(AFPWriter *writer, const CodePage *codepage, const unsigned char *data, size_t length) {
+    if (!writer->file)
+        return;
+
+    while (length > 0) {
+        size_t count = length < WRITER_BUFFER_SIZE / 2 ? length : WRITER_BUFFER_SIZE / 2;
+        char *p = writer_reserve(writer, 2 * count);
+        writer->length += ebcdic_to_utf8(codepage, data, count, p);
+        data += count;
+        length -= count;
+    }
+}
@@ -0,0 +1,427 @@
+// Throughput benchmark. Generates synthetic AFP files of a few typical
+// shapes, validates each one in every mode in a child process and prints
+// one JSON line per run with fields/s, MB/s and the peak resident size.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "afp_internal.h"
+
+// Synthetic file being written
+typedef struct {
+    FILE *file;
+    uint64_t size;
+    uint64_t fields;
+    uint32_t seed;
+    bool sparse; // Leave data payloads as holes
+} Generator;
+
+static uint32_t next_random(Generator *gen) {
+    gen->seed = gen->seed * 1103515245u + 12345u;
+    return gen->seed >> 8;
+}
+
+// 8-byte EBCDIC name, blank padded (letters and digits only)
+static void ebcdic_name8(const char *ascii, unsigned char *name) {
+    memset(name, 0x40, 8);
+    for (int i = 0; i < 8 && ascii[i]; i++) {
+        char c = ascii[i];
+        if (c >= '0' && c <= '9')
+            name[i] = (unsigned char)(0xF0 + (c - '0'));
+        else if (c >= 'A' && c <= 'I')
+            name[i] = (unsigned char)(0xC1 + (c - 'A'));
+        else if (c >= 'J' && c <= 'R')
+            name[i] = (unsigned char)(0xD1 + (c - 'J'));
+        else if (c >= 'S' && c <= 'Z')
+            name[i] = (unsigned char)(0xE2 + (c - 'S'));
+    }
+}
+
+// Structured field: introducer, length, D3 type, flag, reserved bytes,
+// payload. A NULL payload is seeked over and reads back as zeros.
+static void put_field(Generator *gen, uint16_t code, const unsigned char *payload, size_t length) {
+    unsigned char header[9] = {SF_INTRODUCER, (unsigned char)((8 + length) >> 8), (unsigned char)(8 + length),
+                               0xD3, (unsigned char)(code >> 8), (unsigned char)code, 0, 0, 0};
+    fwrite(header, 1, sizeof(header), gen->file);
+    if (!payload)
+        afp_fseek(gen->file, (int64_t)length, SEEK_CUR);
+    else if (length > 0)
+        fwrite(payload, 1, length, gen->file);
+    gen->size += sizeof(header) + length;
+    gen->fields++;
+}
+
+static void put_named(Generator *gen, uint16_t code, const char *name) {
+    unsigned char payload[8];
+    ebcdic_name8(name, payload);
+    put_field(gen, code, payload, sizeof(payload));
+}
+
+static void put_data(Generator *gen, uint16_t code, size_t length) {
+    static unsigned char data[32000];
+    if (gen->sparse) {
+        put_field(gen, code, NULL, length);
+        return;
+    }
+    for (size_t i = 0; i < length; i += 4) {
+        uint32_t r = next_random(gen);
+        memcpy(data + i, &r, length - i < 4 ? length - i : 4);
+    }
+    put_field(gen, code, data, length);
+}
+
+// EBCDIC lowercase letter, one in four a blank
+static unsigned char text_char(Generator *gen) {
+    uint32_t r = next_random(gen);
+    uint32_t k = (r >> 2) % 26;
+    if (r % 4 == 0)
+        return 0x40;
+    return (unsigned char)(k < 9 ? 0x81 + k : k < 18 ? 0x91 + k - 9 : 0xA2 + k - 18);
+}
+
+// Presentation text: lines of Absolute Move Baseline, Absolute Move Inline
+// and Transparent Data control sequences, blank padded
+static void put_text(Generator *gen, size_t length) {
+    static unsigned char data[32000];
+    if (gen->sparse) {
+        put_field(gen, 0xEE9B, NULL, length);
+        return;
+    }
+    size_t used = 0;
+    for (unsigned line = 1; length - used >= 16; line++) {
+        size_t chars = length - used - 12 < 80 ? length - used - 12 : 80;
+        unsigned baseline = line * 240;
+        unsigned char head[12] = {0x2B, 0xD3, 4, 0xD3, (unsigned char)(baseline >> 8), (unsigned char)baseline,
+                                  4, 0xC7, 0, 0x60, (unsigned char)(chars + 2), 0xDA};
+        memcpy(data + used, head, sizeof(head));
+        used += sizeof(head);
+        for (size_t i = 0; i < chars; i++)
+            data[used++] = text_char(gen);
+    }
+    memset(data + used, 0x40, length - used);
+    put_field(gen, 0xEE9B, data, length);
+}
+
+// Overlay in a resource group, included on every page
+static void put_resources(Generator *gen) {
+    put_named(gen, 0xA8C6, "RG1");
+    put_named(gen, 0xA8DF, "O1");
+    put_named(gen, 0xA8C9, "");
+    put_named(gen, 0xA9C9, "");
+    put_text(gen, 200);
+    put_named(gen, 0xA9DF, "O1");
+    put_named(gen, 0xA9C6, "RG1");
+}
+
+static void put_page_start(Generator *gen, uint64_t page) {
+    char name[9];
+    snprintf(name, sizeof(name), "P%llu", (unsigned long long)(page % 10000000));
+    put_named(gen, 0xA8AF, name);
+    put_named(gen, 0xA8C9, "");
+    put_named(gen, 0xA9C9, "");
+    put_named(gen, 0xAFD8, "O1");
+}
+
+static void put_page_end(Generator *gen, uint64_t page) {
+    char name[9];
+    snprintf(name, sizeof(name), "P%llu", (unsigned long long)(page % 10000000));
+    put_named(gen, 0xA9AF, name);
+}
+
+typedef enum {
+    SHAPE_TEXT,    // Many small presentation text fields
+    SHAPE_IMAGE,   // Pages of large image data fields
+    SHAPE_NESTED,  // Page groups nested deeply
+    SHAPE_CORRUPT, // Text pages with garbage between fields
+    SHAPE_LARGE,   // Image pages past 4 GB, payloads left as holes (-l only)
+    SHAPE_COUNT
+} BenchShape;
+
+static const char *shape_names[SHAPE_COUNT] = {"text", "image", "nested", "corrupt", "large"};
+
+#define NESTING_DEPTH 32
+#define LARGE_SIZE (9ull << 29) // 4.5 GiB: positions and sizes past 32 bits
+
+// Write a file of about target bytes in the given shape
+static bool generate(const char *path, BenchShape shape, uint64_t target, uint64_t *size, uint64_t *fields) {
+    Generator gen = {fopen(path, "wb"), 0, 0, 12345u, shape == SHAPE_LARGE};
+    if (!gen.file)
+        return false;
+    uint64_t clean_after = 0; // Resynchronizing needs a chain of good fields after garbage
+
+    put_named(&gen, 0xA8A8, "DOC");
+    put_resources(&gen);
+    for (uint64_t page = 0; gen.size < target; page++) {
+        if (shape == SHAPE_NESTED) {
+            char name[13]; // "G", any int, NUL; names are cut to 8 characters
+            for (int depth = 0; depth < NESTING_DEPTH; depth++) {
+                snprintf(name, sizeof(name), "G%d", depth);
+                put_named(&gen, 0xA8AD, name);
+            }
+            put_page_start(&gen, page);
+            put_text(&gen, 120);
+            put_page_end(&gen, page);
+            for (int depth = NESTING_DEPTH - 1; depth >= 0; depth--) {
+                snprintf(name, sizeof(name), "G%d", depth);
+                put_named(&gen, 0xA9AD, name);
+            }
+            continue;
+        }
+
+        put_page_start(&gen, page);
+        if (shape == SHAPE_IMAGE || shape == SHAPE_LARGE) {
+            put_named(&gen, 0xA8FB, "IMG");
+            put_named(&gen, 0xA8C7, "");
+            put_named(&gen, 0xA9C7, "");
+            for (int i = 0; i < 8; i++)
+                put_data(&gen, 0xEEFB, 32000);
+            put_named(&gen, 0xA9FB, "IMG");
+        } else {
+            for (int i = 0; i < 60; i++) {
+                put_text(&gen, 40 + next_random(&gen) % 200);
+                if (shape == SHAPE_CORRUPT && next_random(&gen) % 500 == 0 && gen.fields >= clean_after) {
+                    clean_after = gen.fields + RESYNC_CHAIN_LENGTH;
+                    unsigned char garbage[16];
+                    memset(garbage, 0xFF, sizeof(garbage));
+                    fwrite(garbage, 1, sizeof(garbage), gen.file);
+                    gen.size += sizeof(garbage);
+                }
+            }
+        }
+        put_page_end(&gen, page);
+    }
+    put_named(&gen, 0xA9A8, "DOC");
+
+    bool ok = !ferror(gen.file);
+    *size = gen.size;
+    *fields = gen.fields;
+    return fclose(gen.file) == 0 && ok;
+}
+
+typedef struct {
+    const char *name;
+    bool structure_only;
+    bool deep;
+    bool fingerprint;
+    bool parallel;
+    bool extract_text;
+} BenchMode;
+
+static const BenchMode modes[] = {
+    {"serial", false, false, false, false, false},
+    {"structure-only", true, false, false, false, false},
+    {"deep", false, true, false, false, false},
+    {"fingerprint", false, false, true, false, false},
+    {"parallel", false, false, false, true, false},
+    {"extract-text", false, false, false, false, true},
+};
+
+#define MODE_COUNT (sizeof(modes) / sizeof(modes[0]))
+
+typedef struct {
+    bool ok;
+    bool valid;
+    uint64_t fields;
+    uint64_t elapsed_us;
+    uint64_t peak_rss_kb;
+} BenchRun;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+// Validate in a child so each run has its own peak resident size
+static BenchRun run_once(const char *path, const ValidationOptions *options, bool extract_text) {
+    BenchRun run;
+    memset(&run, 0, sizeof(run));
+    int fds[2];
+    if (pipe(fds) != 0)
+        return run;
+
+    uint64_t start = now_us();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        FILE *devnull = fopen("/dev/null", "w");
+        ValidationResult result;
+        memset(&result, 0, sizeof(result));
+        AFPValidator *validator = afp_validator_create(options);
+        if (validator) {
+            afp_validator_set_output(validator, devnull);
+            if (extract_text)
+                afp_validator_set_text_output(validator, devnull);
+            afp_validator_run(validator, path, &result);
+            afp_validator_destroy(validator);
+        }
+        ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return run;
+    }
+
+    ValidationResult result;
+    bool received = read(fds[0], &result, sizeof(result)) == (ssize_t)sizeof(result);
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || !received)
+        return run;
+
+    run.elapsed_us = now_us() - start;
+    run.ok = result.opened;
+    run.valid = result.is_valid;
+    run.fields = result.field_count;
+#ifdef __APPLE__
+    run.peak_rss_kb = (uint64_t)usage.ru_maxrss / 1024; // Bytes on macOS
+#else
+    run.peak_rss_kb = (uint64_t)usage.ru_maxrss;
+#endif
+    return run;
+}
+
+static void print_run(AFPWriter *out, const char *shape, const char *mode, int threads, uint64_t size,
+                      const BenchRun *run) {
+    JSONWriter json;
+    uint64_t elapsed = run->elapsed_us > 0 ? run->elapsed_us : 1;
+    json_begin(&json, out);
+    json_string(&json, "event", "bench");
+    json_string(&json, "shape", shape);
+    json_string(&json, "mode", mode);
+    json_uint(&json, "threads", (uint64_t)threads);
+    json_uint(&json, "bytes", size);
+    json_uint(&json, "fields", run->fields);
+    json_bool(&json, "valid", run->valid);
+    json_uint(&json, "elapsed_us", run->elapsed_us);
+    json_uint(&json, "fields_per_second", run->fields * 1000000u / elapsed);
+    json_uint(&json, "mb_per_second", size / elapsed); // Bytes per microsecond = MB/s
+    json_uint(&json, "peak_rss_kb", run->peak_rss_kb);
+    json_end(&json);
+    writer_flush(out);
+}
+
+static void print_usage(const char *program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  -s <MB>: Size of each generated file (default 64)\n");
+    printf("  -r <runs>: Runs per file and mode; the fastest is reported (default 3)\n");
+    printf("  -j <threads>: Threads of the parallel mode (default: all cores)\n");
+    printf("  -d <dir>: Directory for the generated files (default $TMPDIR or /tmp)\n");
+    printf("  -k: Keep the generated files\n");
+    printf("  -l: Also check a sparse file of at least 4.5 GiB (needs a file system with holes)\n");
+    printf("Prints one JSON object per shape and mode: fields/s, MB/s and peak RSS.\n");
+    printf("Exits with 1 when a run finds other fields than were generated.\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t megabytes = 64;
+    int runs = 3;
+    int threads = 0;
+    bool keep = false;
+    bool large = false;
+    const char *dir = getenv("TMPDIR");
+    if (!dir || !*dir)
+        dir = "/tmp";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            megabytes = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "-k") == 0) {
+            keep = true;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            large = true;
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (megabytes == 0 || runs <= 0) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    if (threads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? (int)n : 1;
+    }
+
+    AFPWriter out;
+    writer_init(&out, stdout);
+    int status = 0;
+    for (int shape = 0; shape < SHAPE_COUNT; shape++) {
+        char path[4096];
+        uint64_t size, fields;
+        uint64_t target = megabytes * 1000000u;
+        if (shape == SHAPE_LARGE) {
+            if (!large)
+                continue;
+            if (target < LARGE_SIZE)
+                target = LARGE_SIZE;
+        }
+        snprintf(path, sizeof(path), "%s/afpbench-%s.afp", dir, shape_names[shape]);
+        if (!generate(path, (BenchShape)shape, target, &size, &fields)) {
+            fprintf(stderr, "Error: Cannot write %s\n", path);
+            remove(path);
+            return 2;
+        }
+
+        for (size_t m = 0; m < MODE_COUNT; m++) {
+            ValidationOptions options = {.threads = 1, .format = AFP_REPORT_TEXT,
+                                         .fingerprint = modes[m].fingerprint, .deep = modes[m].deep,
+                                         .structure_only = modes[m].structure_only};
+            if (modes[m].parallel)
+                options.threads = threads;
+
+            // Fastest run, with the highest peak of all runs
+            BenchRun best;
+            uint64_t peak_rss_kb = 0;
+            memset(&best, 0, sizeof(best));
+            for (int r = 0; r < runs; r++) {
+                BenchRun run = run_once(path, &options, modes[m].extract_text);
+                if (!run.ok) {
+                    best.ok = false;
+                    break;
+                }
+                if (!best.ok || run.elapsed_us < best.elapsed_us)
+                    best = run;
+                if (run.peak_rss_kb > peak_rss_kb)
+                    peak_rss_kb = run.peak_rss_kb;
+            }
+            best.peak_rss_kb = peak_rss_kb;
+            if (!best.ok) {
+                fprintf(stderr, "Error: Cannot validate %s\n", path);
+                status = 2;
+                continue;
+            }
+            print_run(&out, shape_names[shape], modes[m].name, options.threads, size, &best);
+
+            // Every mode must find exactly the generated fields
+            if (best.fields != fields || best.valid != (shape != SHAPE_CORRUPT)) {
+                fprintf(stderr, "Error: %s %s found %llu of %llu fields and is %s\n", shape_names[shape],
+                        modes[m].name, (unsigned long long)best.fields, (unsigned long long)fields,
+                        best.valid ? "valid" : "invalid");
+                if (status == 0)
+                    status = 1;
+            }
+        }
+        if (!keep)
+            remove(path);
+    }
+    return status;
+}
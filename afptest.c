@@ -0,0 +1,309 @@
+// Regression tests. Each test builds a small AFP file in memory, runs it
+// through the library and compares the output with what is expected.
+// Prints one line per failure; the exit status is the number of failures.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "afpvalidator.h"
+
+// AFP file being built
+typedef struct {
+    unsigned char data[4096];
+    size_t length;
+} Buffer;
+
+static int failures;
+
+static void check(bool ok, const char *test, const char *what) {
+    if (!ok) {
+        printf("FAIL %s: %s\n", test, what);
+        failures++;
+    }
+}
+
+// Structured field: introducer, length, D3 type, flag, reserved bytes, payload
+static void put_field(Buffer *buffer, uint16_t code, const unsigned char *payload, size_t length) {
+    unsigned char header[9] = {0x5A, (unsigned char)((8 + length) >> 8), (unsigned char)(8 + length),
+                               0xD3, (unsigned char)(code >> 8), (unsigned char)code, 0, 0, 0};
+    memcpy(buffer->data + buffer->length, header, sizeof(header));
+    memcpy(buffer->data + buffer->length + sizeof(header), payload, length);
+    buffer->length += sizeof(header) + length;
+}
+
+// Field with an 8-byte EBCDIC name
+static void put_named(Buffer *buffer, uint16_t code, const char *name) {
+    put_field(buffer, code, (const unsigned char *)name, 8);
+}
+
+// Write the file to path
+static bool write_file(const char *path, const Buffer *buffer) {
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(buffer->data, 1, buffer->length, file) == buffer->length;
+    return fclose(file) == 0 && ok;
+}
+
+// Validate a file without a report; false when the run could not be set up
+static bool validate_file(const ValidationOptions *options, const char *path, ValidationResult *result) {
+    AFPValidator *validator = afp_validator_create(options);
+    if (!validator)
+        return false;
+    memset(result, 0, sizeof(*result));
+    afp_validator_run(validator, path, result);
+    afp_validator_destroy(validator);
+    return result->opened;
+}
+
+// Validate a file into a report of up to size - 1 bytes; false when the run
+// could not be set up
+static bool report_file(const ValidationOptions *options, const char *path, char *report, size_t size) {
+    AFPValidator *validator = afp_validator_create(options);
+    FILE *out = tmpfile();
+    if (!validator || !out) {
+        if (out)
+            fclose(out);
+        afp_validator_destroy(validator);
+        return false;
+    }
+    afp_validator_set_output(validator, out);
+    afp_validator_run(validator, path, NULL);
+    afp_validator_destroy(validator);
+
+    rewind(out);
+    size_t length = fread(report, 1, size - 1, out);
+    report[length] = '\0';
+    fclose(out);
+    return length > 0;
+}
+
+#define NAME_DOC "\xC4\xD6\xC3\x40\x40\x40\x40\x40" // DOC
+#define NAME_PAGE "\xD7\xF1\x40\x40\x40\x40\x40\x40" // P1
+#define NAME_GROUP "\xD9\xC7\x40\x40\x40\x40\x40\x40" // RG
+#define NAME_OVERLAY "\xD6\xF1\x40\x40\x40\x40\x40\x40" // O1
+
+// Line feed (0x25) and form feed (0x0C) in the text are characters, not
+// breaks: only the Begin Line and the end of the page break the text
+static void test_text_controls(void) {
+    static const unsigned char ptoca[] = {
+        0x2B, 0xD3,
+        0x07, 0xDB, 0xC1, 0x25, 0xC2, 0x0C, 0xC3, // TRN "A", LF, "B", FF, "C" (chained)
+        0x02, 0xD9,                               // BLN (chained)
+        0x03, 0xDA, 0xC4                          // TRN "D"
+    };
+
+    Buffer buffer = {{0}, 0};
+    put_named(&buffer, 0xA8A8, NAME_DOC);
+    put_named(&buffer, 0xA8AF, NAME_PAGE);
+    put_field(&buffer, 0xEE9B, ptoca, sizeof(ptoca));
+    put_named(&buffer, 0xA9AF, NAME_PAGE);
+    put_named(&buffer, 0xA9A8, NAME_DOC);
+
+    FILE *text = tmpfile();
+    ValidationOptions options = {.threads = 1, .format = AFP_REPORT_TEXT, .codepage = 500};
+    AFPValidator *validator = afp_validator_create(&options);
+    if (!text || !validator) {
+        check(false, "text_controls", "setup failed");
+        return;
+    }
+    afp_validator_set_text_output(validator, text);
+    afp_validator_run_buffer(validator, buffer.data, buffer.length, NULL);
+    afp_validator_destroy(validator);
+
+    char got[64];
+    rewind(text);
+    size_t length = fread(got, 1, sizeof(got) - 1, text);
+    got[length] = '\0';
+    fclose(text);
+    check(strcmp(got, "A.B.C\nD\n\f") == 0, "text_controls", "controls in the text came out as breaks");
+}
+
+// Whether the file holds the bytes
+static bool file_contains(const char *path, const unsigned char *bytes, size_t length) {
+    unsigned char data[4096];
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+    size_t size = fread(data, 1, sizeof(data), file);
+    fclose(file);
+    for (size_t i = 0; i + length <= size; i++) {
+        if (memcmp(data + i, bytes, length) == 0)
+            return true;
+    }
+    return false;
+}
+
+// A resource group inside the document, before its first page, is repeated
+// in every part, so an overlay it defines resolves in all of them
+static void test_split_document_resources(void) {
+    static const unsigned char include_overlay[] = {
+        0xD6, 0xF1, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, // O1
+        0, 0, 0, 0, 0, 0,                               // Origin
+        0, 0                                            // Rotation
+    };
+
+    Buffer buffer = {{0}, 0};
+    put_named(&buffer, 0xA8A8, NAME_DOC);
+    size_t group = buffer.length;
+    put_named(&buffer, 0xA8C6, NAME_GROUP);
+    put_named(&buffer, 0xA8DF, NAME_OVERLAY);
+    put_named(&buffer, 0xA9DF, NAME_OVERLAY);
+    put_named(&buffer, 0xA9C6, NAME_GROUP);
+    size_t group_end = buffer.length;
+    for (int i = 0; i < 3; i++) {
+        put_named(&buffer, 0xA8AF, NAME_PAGE);
+        put_field(&buffer, 0xAFD8, include_overlay, sizeof(include_overlay));
+        put_named(&buffer, 0xA9AF, NAME_PAGE);
+    }
+    put_named(&buffer, 0xA9A8, NAME_DOC);
+
+    const char *input = "afptest-split.afp";
+    if (!write_file(input, &buffer)) {
+        check(false, "split_document_resources", "setup failed");
+        return;
+    }
+
+    AFPSplitResult split;
+    bool ok = afp_split(input, false, 1, "afptest-split-", &split);
+    check(ok && split.parts == 3, "split_document_resources", "the file did not split into three parts");
+
+    ValidationOptions options = {.threads = 1, .format = AFP_REPORT_TEXT};
+    for (size_t part = 1; ok && part <= split.parts; part++) {
+        char path[64];
+        snprintf(path, sizeof(path), "afptest-split-%04zu.afp", part);
+        check(file_contains(path, buffer.data + group, group_end - group), "split_document_resources",
+              "a part lacks the resource group of its document");
+
+        ValidationResult result;
+        check(validate_file(&options, path, &result) && result.is_valid, "split_document_resources",
+              "a part does not validate");
+        remove(path);
+    }
+    remove(input);
+}
+
+// A run stopped by the error limit writes no index, so a later indexed run
+// does not take its counts for those of the whole file
+static void test_index_after_error_limit(void) {
+    Buffer buffer = {{0}, 0};
+    put_named(&buffer, 0xA8A8, NAME_DOC);
+    for (int i = 0; i < 16; i++) {
+        put_named(&buffer, 0xA8AF, NAME_PAGE);
+        put_named(&buffer, 0xA9AF, NAME_PAGE);
+        if (i % 4 == 3 && i < 15)
+            buffer.data[buffer.length++] = 0; // A stray byte, one error each
+    }
+    put_named(&buffer, 0xA9A8, NAME_DOC);
+
+    const char *input = "afptest-index.afp";
+    const char *sidecar = "afptest-index.afp.afpidx";
+    remove(sidecar);
+    ValidationOptions plain = {.threads = 1, .format = AFP_REPORT_TEXT};
+    ValidationOptions limited = {.threads = 1, .max_errors = 2, .index = true, .format = AFP_REPORT_TEXT};
+    ValidationOptions indexed = {.threads = 1, .index = true, .format = AFP_REPORT_TEXT};
+    ValidationResult full, stopped, later;
+    bool ok = write_file(input, &buffer) && validate_file(&plain, input, &full) &&
+              validate_file(&limited, input, &stopped) && validate_file(&indexed, input, &later);
+    check(ok, "index_after_error_limit", "setup failed");
+    check(!ok || (full.error_count == 3 && stopped.error_count == 2), "index_after_error_limit",
+          "unexpected error counts");
+    check(!ok || (later.field_count == full.field_count && later.error_count == full.error_count),
+          "index_after_error_limit", "the indexed run reported the counts of the stopped one");
+    remove(sidecar);
+    remove(input);
+}
+
+// The summary in the index of a plain run does not stand for a --deep run,
+// which also checks the triplets
+static void test_index_settings(void) {
+    static const unsigned char document[] = {
+        0xC4, 0xD6, 0xC3, 0x40, 0x40, 0x40, 0x40, 0x40, // DOC
+        0x00, 0x00,                                     // Reserved
+        0x0A, 0x01, 0x00                                // Triplet running past the field
+    };
+
+    Buffer buffer = {{0}, 0};
+    put_field(&buffer, 0xA8A8, document, sizeof(document));
+    put_named(&buffer, 0xA8AF, NAME_PAGE);
+    put_named(&buffer, 0xA9AF, NAME_PAGE);
+    put_named(&buffer, 0xA9A8, NAME_DOC);
+
+    const char *input = "afptest-deep.afp";
+    const char *sidecar = "afptest-deep.afp.afpidx";
+    remove(sidecar);
+    ValidationOptions plain = {.threads = 1, .index = true, .format = AFP_REPORT_TEXT};
+    ValidationOptions deep = {.threads = 1, .index = true, .format = AFP_REPORT_TEXT, .deep = true};
+    ValidationResult first, second;
+    bool ok = write_file(input, &buffer) && validate_file(&plain, input, &first) &&
+              validate_file(&deep, input, &second);
+    check(ok, "index_settings", "setup failed");
+    check(!ok || first.is_valid, "index_settings", "the plain run found an error");
+    check(!ok || (!second.is_valid && second.error_count == 1), "index_settings",
+          "the deep run took the summary of the plain one");
+    remove(sidecar);
+    remove(input);
+}
+
+// A summary loaded from the index reports the resource references of the
+// scan that wrote it
+static void test_index_resources(void) {
+    static const unsigned char include_overlay[] = {
+        0xD6, 0xF1, 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, // O1
+        0, 0, 0, 0, 0, 0,                               // Origin
+        0, 0                                            // Rotation
+    };
+
+    Buffer buffer = {{0}, 0};
+    put_named(&buffer, 0xA8C6, NAME_GROUP);
+    put_named(&buffer, 0xA8DF, NAME_OVERLAY);
+    put_named(&buffer, 0xA9DF, NAME_OVERLAY);
+    put_named(&buffer, 0xA9C6, NAME_GROUP);
+    put_named(&buffer, 0xA8A8, NAME_DOC);
+    put_named(&buffer, 0xA8AF, NAME_PAGE);
+    put_field(&buffer, 0xAFD8, include_overlay, sizeof(include_overlay));
+    put_named(&buffer, 0xA9AF, NAME_PAGE);
+    put_named(&buffer, 0xA9A8, NAME_DOC);
+
+    const char *input = "afptest-resources.afp";
+    const char *sidecar = "afptest-resources.afp.afpidx";
+    remove(sidecar);
+    ValidationOptions options = {.threads = 1, .index = true, .format = AFP_REPORT_JSON};
+    static char scanned[16384], loaded[16384];
+    bool ok = write_file(input, &buffer) && report_file(&options, input, scanned, sizeof(scanned)) &&
+              report_file(&options, input, loaded, sizeof(loaded));
+    check(ok, "index_resources", "setup failed");
+    check(!ok || strstr(scanned, "resource_references") != NULL, "index_resources",
+          "the scan reported no resource references");
+    check(!ok || strcmp(scanned, loaded) == 0, "index_resources",
+          "the summary loaded from the index differs from the scan");
+    remove(sidecar);
+    remove(input);
+}
+
+// An empty batch is valid and reports nothing
+static void test_batch_empty(void) {
+    ValidationOptions options = {.threads = 4, .format = AFP_REPORT_TEXT};
+    FILE *out = tmpfile();
+    if (!out) {
+        check(false, "batch_empty", "setup failed");
+        return;
+    }
+    check(validate_batch(NULL, 0, &options, out) == 0, "batch_empty", "an empty batch is not valid");
+    check(ftell(out) == 0, "batch_empty", "an empty batch wrote a report");
+    fclose(out);
+}
+
+int main(void) {
+    test_text_controls();
+    test_split_document_resources();
+    test_index_after_error_limit();
+    test_index_settings();
+    test_index_resources();
+    test_batch_empty();
+    if (failures == 0)
+        printf("All tests passed\n");
+    return failures;
+}
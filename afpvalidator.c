@@ -2,839 +2,407 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <stdint.h>
 
-#define SF_INTRODUCER 0x5A
+#include <dirent.h>
+#include <sys/stat.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
 
-// AFP architecture components
-typedef enum {
-    COMPONENT_UNKNOWN,
-    COMPONENT_DOCUMENT,
-    COMPONENT_PAGE_GROUP,
-    COMPONENT_PAGE,
-    COMPONENT_OBJECT,
-    COMPONENT_RESOURCE_GROUP,
-    COMPONENT_OVERLAY,
-    COMPONENT_RESOURCE
-} AFPComponent;
+#include "afpvalidator.h"
 
-// AFP data object types
-typedef enum {
-    OBJ_UNKNOWN,
-    OBJ_PRESENTATIONTEXT,
-    OBJ_IMAGE,
-    OBJ_GRAPHICS,
-    OBJ_BARCODE,
-    OBJ_FONT,
-    OBJ_PAGSEG,
-    OBJ_FORMDEF,
-    OBJ_RESLIB
-} AFPObjectType;
-
-typedef struct {
-    uint16_t length;
-    unsigned char type[3];
-    unsigned char flags;
-    unsigned char *data;
-    AFPComponent component;
-    AFPObjectType obj_type;
-    char name[9]; // Resource/Page name (null-terminated)
-} StructuredField;
+void print_logo(){
+    //https://patorjk.com/software/taag/#p=testall&f=Big&t=AfpValidator
+    printf("%s\n","            __   __      __   _ _     _       _             ");
+    printf("%s\n","     /\\    / _|  \\ \\    / /  | (_)   | |     | |            ");
+    printf("%s\n","    /  \\  | |_ _ _\\ \\  / /_ _| |_  __| | __ _| |_ ___  _ __ ");
+    printf("%s\n","   / /\\ \\ |  _| '_ \\ \\/ / _` | | |/ _` |/ _` | __/ _ \\| '__|");
+    printf("%s\n","  / ____ \\| | | |_) \\  / (_| | | | (_| | (_| | || (_) | |   ");
+    printf("%s\n"," /_/    \\_\\_| | .__/ \\/ \\__,_|_|_|\\__,_|\\__,_|\\__\\___/|_|   ");
+    printf("%s\n","              | |                                           ");
+    printf("%s\n","              |_|                      By Began BALAKRISHNAN");
+}
 
-// Stack for tracking document structure nesting
-#define MAX_STACK_SIZE 100
+// Input file list built from arguments, list files and directories
 typedef struct {
-    AFPComponent components[MAX_STACK_SIZE];
-    int top;
-} ComponentStack;
+    char **items;
+    size_t count;
+    size_t capacity;
+} FileList;
 
-// Initialize stack
-void stack_init(ComponentStack *stack) {
-    stack->top = -1;
-}
+static bool file_list_add(FileList *list, const char *filename) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        char **items = realloc(list->items, capacity * sizeof(char *));
+        if (!items)
+            return false;
+        list->items = items;
+        list->capacity = capacity;
+    }
 
-// Push component to stack
-bool stack_push(ComponentStack *stack, AFPComponent component) {
-    if (stack->top >= MAX_STACK_SIZE - 1)
+    size_t length = strlen(filename) + 1;
+    char *copy = malloc(length);
+    if (!copy)
         return false;
-    stack->components[++(stack->top)] = component;
+    memcpy(copy, filename, length);
+    list->items[list->count++] = copy;
     return true;
 }
 
-// Pop component from stack
-AFPComponent stack_pop(ComponentStack *stack) {
-    if (stack->top < 0)
-        return COMPONENT_UNKNOWN;
-    return stack->components[(stack->top)--];
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
 }
 
-// Peek at top component
-AFPComponent stack_peek(ComponentStack *stack) {
-    if (stack->top < 0)
-        return COMPONENT_UNKNOWN;
-    return stack->components[stack->top];
-}
+// Add a path; directories contribute the regular files they contain
+static bool file_list_add_path(FileList *list, const char *path, bool *is_directory) {
+    struct stat st;
+    *is_directory = false;
+    if (strcmp(path, "-") == 0 || stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return file_list_add(list, path);
 
-// Is stack empty
-bool stack_empty(ComponentStack *stack) {
-    return stack->top < 0;
-}
+    *is_directory = true;
+    DIR *dir = opendir(path);
+    if (!dir)
+        return file_list_add(list, path);
 
-// Function to identify field type
-void identify_field_type(StructuredField *field) {
-    // Initialize with defaults
-    field->component = COMPONENT_UNKNOWN;
-    field->obj_type = OBJ_UNKNOWN;
-    
-    // Begin/End structures
-    if (field->type[0] == 0xD3) {
-        if (field->type[1] == 0xA8) {
-            switch (field->type[2]) {
-                case 0xC6: // BDT
-                    field->component = COMPONENT_DOCUMENT;
-                    break;
-                case 0xC8: // EDT
-                    field->component = COMPONENT_DOCUMENT;
-                    break;
-                case 0xAF: // BPG
-                    field->component = COMPONENT_PAGE;
-                    break;
-                case 0xD8: // EPG
-                    field->component = COMPONENT_PAGE;
-                    break;
-                case 0xD6: // BNG
-                    field->component = COMPONENT_PAGE_GROUP;
-                    break;
-                case 0xD9: // ENG
-                    field->component = COMPONENT_PAGE_GROUP;
-                    break;
-                case 0xA8: // BAG
-                    field->component = COMPONENT_OBJECT;
-                    break;
-                case 0xA9: // EAG
-                    field->component = COMPONENT_OBJECT;
-                    break;
-                case 0xDF: // BRG
-                    field->component = COMPONENT_RESOURCE_GROUP;
-                    break;
-                case 0xE3: // ERG
-                    field->component = COMPONENT_RESOURCE_GROUP;
-                    break;
-                case 0xBB: // BMO
-                    field->component = COMPONENT_OVERLAY;
-                    break;
-                case 0xEB: // EMO
-                    field->component = COMPONENT_OVERLAY;
-                    break;
-            }
-        }
-    }
-    
-    // Data objects and resources
-    else if (field->type[0] == 0xD3) {
-        // Presentation Text
-        if (field->type[1] == 0xEE && field->type[2] == 0xBB) {
-            field->obj_type = OBJ_PRESENTATIONTEXT; // PTD
-        }
-        // Image
-        else if ((field->type[1] == 0x87 && field->type[2] == 0x8A) || // IOCA
-                 (field->type[1] == 0xA7 && field->type[2] == 0xAB)) { // IRD
-            field->obj_type = OBJ_IMAGE;                 
-        }
-        // Graphics
-        else if (field->type[1] == 0xAF && field->type[2] == 0xA8) {
-            field->obj_type = OBJ_GRAPHICS; // GAD
-        }
-        // Bar code
-        else if (field->type[1] == 0xEB && field->type[2] == 0xBB) {
-            field->obj_type = OBJ_BARCODE; // BDD
-        }
-    }
-    
-    // Font resources
-    else if (field->type[0] == 0xD3 &&
-             ((field->type[1] == 0x8A && field->type[2] == 0x8B) || // FND
-              (field->type[1] == 0x8C && field->type[2] == 0x8A))) { // FNC
-        field->obj_type = OBJ_FONT;
-        field->component = COMPONENT_RESOURCE;
-    }
-    
-    // Form definitions
-    else if (field->type[0] == 0xD3 && field->type[1] == 0xA6 && field->type[2] == 0xAF) {
-        field->obj_type = OBJ_FORMDEF; // FDG
-        field->component = COMPONENT_RESOURCE;
-    }
-    
-    // Resource naming fields
-    if (field->type[0] == 0xD3 && field->type[1] == 0xA6 && field->type[2] == 0x89) { // MCF
-        field->component = COMPONENT_RESOURCE;
-        // Extract resource name from data if available
-        if (field->data && field->length > 9) {
-            // Names in AFP are typically 8 bytes max, in EBCDIC
-            memcpy(field->name, field->data + 2, 8); 
-            field->name[8] = '\0';
+    size_t first = list->count;
+    struct dirent *entry;
+    char child[4096];
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (stat(child, &st) == 0 && S_ISREG(st.st_mode) && !file_list_add(list, child)) {
+            closedir(dir);
+            return false;
         }
     }
-}
+    closedir(dir);
 
-// Function to convert EBCDIC to ASCII (simplified)
-char ebcdic_to_ascii(unsigned char ebcdic) {
-    // Simple conversion for alphanumeric characters only
-    if (ebcdic >= 0xC1 && ebcdic <= 0xC9) return 'A' + (ebcdic - 0xC1);
-    if (ebcdic >= 0xD1 && ebcdic <= 0xD9) return 'J' + (ebcdic - 0xD1);
-    if (ebcdic >= 0xE2 && ebcdic <= 0xE9) return 'S' + (ebcdic - 0xE2);
-    if (ebcdic >= 0xF0 && ebcdic <= 0xF9) return '0' + (ebcdic - 0xF0);
-    return '.';
-}
-
-// Function to print EBCDIC string in readable form
-void print_ebcdic_string(const unsigned char *data, size_t length) {
-    printf("EBCDIC: ");
-    for (size_t i = 0; i < length; i++) {
-        printf("%c", ebcdic_to_ascii(data[i]));
-    }
-    printf("\n");
+    // Directory order is arbitrary; keep reports stable
+    qsort(list->items + first, list->count - first, sizeof(char *), compare_names);
+    return true;
 }
 
-void print_hex(const unsigned char *data, size_t length) {
-    for (size_t i = 0; i < length; i++) {
-        printf("%02X ", data[i]);
-        if ((i + 1) % 16 == 0 && i < length - 1) {
-            printf("\n         ");
-        }
-    }
-    printf("\n");
-}
+// Add every path listed (one per line) in a list file
+static bool file_list_add_listfile(FileList *list, const char *listfile) {
+    FILE *file = fopen(listfile, "r");
+    if (!file)
+        return false;
 
-const char* get_component_name(AFPComponent component) {
-    switch(component) {
-        case COMPONENT_DOCUMENT: return "Document";
-        case COMPONENT_PAGE_GROUP: return "Page Group";
-        case COMPONENT_PAGE: return "Page";
-        case COMPONENT_OBJECT: return "Object";
-        case COMPONENT_RESOURCE_GROUP: return "Resource Group";
-        case COMPONENT_OVERLAY: return "Overlay";
-        case COMPONENT_RESOURCE: return "Resource";
-        default: return "Unknown";
+    char line[4096];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0')
+            continue;
+        bool is_directory;
+        ok = file_list_add_path(list, line, &is_directory);
     }
+    fclose(file);
+    return ok;
 }
 
-const char* get_object_type_name(AFPObjectType type) {
-    switch(type) {
-        case OBJ_PRESENTATIONTEXT: return "Presentation Text";
-        case OBJ_IMAGE: return "Image";
-        case OBJ_GRAPHICS: return "Graphics";
-        case OBJ_BARCODE: return "Barcode";
-        case OBJ_FONT: return "Font";
-        case OBJ_PAGSEG: return "Page Segment";
-        case OBJ_FORMDEF: return "Form Definition";
-        case OBJ_RESLIB: return "Resource Library";
-        default: return "Unknown";
-    }
+static void file_list_free(FileList *list) {
+    for (size_t i = 0; i < list->count; i++)
+        free(list->items[i]);
+    free(list->items);
+    memset(list, 0, sizeof(*list));
 }
 
-void print_ebcdic_type(const unsigned char *type) {
-    printf("EBCDIC Type: %02X%02X%02X (", type[0], type[1], type[2]);
-    
-    // Common MO:DCA structured field types
-    if (type[0] == 0xD3) {
-        if (type[1] == 0xA8) {
-            if (type[2] == 0xA8) printf("BDT - Begin Document");
-            else if (type[2] == 0x92) printf("BOC - Begin Object Container");
-            else if (type[2] == 0xCC) printf("BMM - Begin Medium Map");
-            else if (type[2] == 0xD9) printf("BSG - Begin Resource Environment Group");
-            else if (type[2] == 0xAF) printf("BPG - Begin Page");
-            else if (type[2] == 0xAD) printf("BNG - Begin Named Page Group");
-            else if (type[2] == 0xC9) printf("BAG - Begin Active Environment Group");
-            else if (type[2] == 0xEB) printf("BBC - Begin Bar Code Object");
-            else if (type[2] == 0x77) printf("BCA - Begin Color Attribute Table");
-            else if (type[2] == 0x8A) printf("BCF - Begin Coded Font (BCF)");
-            else if (type[2] == 0x87) printf("BCP - Begin Code Page (BCP)");
-            else if (type[2] == 0xC4) printf("BDG - Begin Document Environment Group");
-            else if (type[2] == 0xA7) printf("BDI - Begin Document Index");
-            else if (type[2] == 0xC5) printf("BFG - Begin Form Environment Group (O)");
-            else if (type[2] == 0xCD) printf("BFM - Begin Form Map");
-            else if (type[2] == 0x89) printf("BFN - Begin Font (BFN)");
-            else if (type[2] == 0xBB) printf("BGR - Begin Graphics Object");
-            else if (type[2] == 0x7B) printf("BII - Begin IM Image (C)");
-            else if (type[2] == 0xFB) printf("BIM - Begin Image Object");
-            else if (type[2] == 0xDF) printf("BMO - Begin Overlay");
-            else if (type[2] == 0xC7) printf("BOG - Begin Object Environment Group");
-            else if (type[2] == 0x5F) printf("BPS - Begin Page Segment");
-            else if (type[2] == 0x9B) printf("BPT - Begin Presentation Text Object");
-            else if (type[2] == 0xC6) printf("BRG - Begin Resource Group");
-            else if (type[2] == 0xCE) printf("BRS - Begin Resource");
-            else printf("Unknown");
-        } 
-        else if (type[1] == 0xA9) {
-            if (type[2] == 0xA8) printf("EDT - End Document");
-            else if (type[2] == 0x92) printf("EOC - End Object Container");
-            else if (type[2] == 0xCC) printf("EMM - End Medium Map");
-            else if (type[2] == 0xD9) printf("BSG - End Resource Environment Group");
-            else if (type[2] == 0xAF) printf("EPG - End Page");
-            else if (type[2] == 0xAD) printf("BNG - End Named Page Group");
-            else if (type[2] == 0xC9) printf("EAG - End Active Environment Group");
-            else if (type[2] == 0xEB) printf("EBC - End Bar Code Object");
-            else if (type[2] == 0x77) printf("ECA - End Color Attribute Table");
-            else if (type[2] == 0x8A) printf("ECF - End Coded Font (BCF)");
-            else if (type[2] == 0x87) printf("ECP - End Code Page (BCP)");
-            else if (type[2] == 0xC4) printf("EDG - End Document Environment Group");
-            else if (type[2] == 0xA7) printf("EDI - End Document Index");
-            else if (type[2] == 0xC5) printf("EFG - End Form Environment Group (O)");
-            else if (type[2] == 0xCD) printf("EFM - End Form Map");
-            else if (type[2] == 0x89) printf("EFN - End Font (BFN)");
-            else if (type[2] == 0xBB) printf("EGR - End Graphics Object");
-            else if (type[2] == 0x7B) printf("EII - End IM Image (C)");
-            else if (type[2] == 0xFB) printf("EIM - End Image Object");
-            else if (type[2] == 0xDF) printf("EMO - End Overlay");
-            else if (type[2] == 0xC7) printf("EOG - End Object Environment Group");
-            else if (type[2] == 0x5F) printf("EPS - End Page Segment");
-            else if (type[2] == 0x9B) printf("EPT - End Presentation Text Object");
-            else if (type[2] == 0xC6) printf("ERG - End Resource Group");
-            else if (type[2] == 0xCE) printf("ERS - End Resource");
-            else printf("Unknown");
-        } 
-        else if (type[1] == 0x8C) {
-            if (type[2] == 0x8A) printf("CFI - Coded Font Index (CFI)");
-            else if (type[2] == 0x87) printf("CPI - Code Page Index (CPI)");
-            else if (type[2] == 0x89) printf("FNI - Font Index (FNI)");
-            else printf("Unknown");
-        } 
-        else if (type[1] == 0xA0) {
-            if (type[2] == 0x88) printf("MFC - Medium Finishing Control");
-            else if (type[2] == 0x90) printf("TLE - Tag Logical Element");
-            else printf("Unknown");
-        } 
-        else if (type[1] == 0xA2) {
-            if (type[2] == 0x89) printf("FNM - Font Patterns Map (FNM)");
-            else if (type[2] == 0x88) printf("MCC - Medium Copy Count");
-            else printf("Unknown");
-        }
-        else if (type[1] == 0xA6) {
-            if (type[2] == 0x92) printf("CDD - Container Data Descriptor");
-            else if (type[2] == 0x87) printf("CPD - Code Page Descriptor (CPD)");
-            else if (type[2] == 0xC5) printf("FGD - Form Environment Group Descriptor (O)");
-            else if (type[2] == 0x89) printf("FND - Font Descriptor (FND)");
-            else if (type[2] == 0xBB) printf("GDD - Graphics Data Descriptor");
-            else if (type[2] == 0xFB) printf("IDD - Image Data Descriptor");
-            else if (type[2] == 0x7B) printf("IID - Image Input Descriptor (C)");
-            else if (type[2] == 0x88) printf("MDD - Medium Descriptor");
-            else if (type[2] == 0x6B) printf("OBD - Object Area Descriptor");
-            else if (type[2] == 0xAF) printf("PGD - Page Descriptor");
-            else if (type[2] == 0x9B) printf("PTD_1 - Presentation Text Descriptor Format-1 (C)");
-            else if (type[2] == 0xEB) printf("BDD - Bar Code Data Descriptor");
-            else printf("Unknown");
-        }
-        else if (type[1] == 0xA7) {
-            if (type[2] == 0x8A) printf("CFC - Coded Font Control (CFC)");
-            else if (type[2] == 0x87) printf("CPC - Code Page Control (CPC)");
-            else if (type[2] == 0x9B) printf("CTC - Composed Text Control (O)");
-            else if (type[2] == 0x89) printf("FNC - Font Control (FNC)");
-            else if (type[2] == 0x7B) printf("IOC - IM Image Output Control (C)");
-            else if (type[2] == 0x88) printf("MMC - Medium Modification Control");
-            else if (type[2] == 0xA8) printf("PEC - Presentation Environment Control");
-            else if (type[2] == 0xAF) printf("PMC - Page Modification Control");
-            else if (type[2] == 0xAB) printf("IRD - Image Raster Data");
-            else printf("Unknown");
-        } 
-        else if (type[1] == 0xAB) {
-            if (type[2] == 0x89) printf("FNN - Font Name Map (FNN)");
-            else if (type[2] == 0xCC) printf("IMM - Invoke Medium Map");
-            else if (type[2] == 0xEB) printf("MBC - Map Bar Code Object");
-            else if (type[2] == 0x77) printf("MCA - Map Color Attribute Table");
-            else if (type[2] == 0x92) printf("MCD - Map Container Data");
-            else if (type[2] == 0x8A) printf("MCF - Map Coded Font");
-            else if (type[2] == 0xC3) printf("MDR - Map Data Resource");
-            else if (type[2] == 0xBB) printf("MGO - Map Graphics Object");
-            else if (type[2] == 0xFB) printf("MIO - Map Image Object");
-            else if (type[2] == 0x88) printf("MMT - Map Media Type");
-            else if (type[2] == 0xAF) printf("MPG - Map Page");
-            else if (type[2] == 0xD8) printf("MPO - Map Page Overlay");
-            else if (type[2] == 0xEA) printf("MSU - Map Suppression");
-            else printf("Unknown");
-        } 
-        else if (type[1] == 0xAC) {
-            if (type[2] == 0x89) printf("FNP - Font Position (FNP)");
-            else if (type[2] == 0x7B) printf("IPC - IM Image Cell Position (C)");
-            else if (type[2] == 0x6B) printf("OBP - Object Area Position");
-            else if (type[2] == 0xAF) printf("PGP_1 - Page Position Format-1 (C)");
-            else printf("Unknown");
-        } 
-        else if (type[1] == 0xAD && type[2] == 0xC3) {
-            printf("PPO - Preprocess Presentation Object");
-        }
-        else if (type[1] == 0xAE && type[2] == 0x89) {
-            printf("FNO - Font Orientation (FNO)");
-        }
-        else if (type[1] == 0xAF) {
-            if (type[2] == 0xC3) printf("IOB - Include Object");
-            else if (type[2] == 0xAF) printf("IPG - Include Page");
-            else if (type[2] == 0xD8) printf("IPO - Include Page Overlay");
-            else if (type[2] == 0x5F) printf("IPS - Include Page Segment");
-            else if (type[2] == 0xA8) printf("GAD - Graphics Data");
-            else printf("Unknown");
-        }
-        else if (type[1] == 0xB0 && type[2] == 0x77) {
-            printf("CAT - Color Attribute Table");
-        }
-        else if (type[1] == 0xB1) {
-            if (type[2] == 0x8A) printf("MCF_1 - Map Coded Font Format-1 (C)");
-            else if (type[2] == 0xDF) printf("MMO - Map Medium Overlay");
-            else if (type[2] == 0x5F) printf("MPS - Map Page Segment");
-            else if (type[2] == 0xAF) printf("PGP - Page Position");
-            else if (type[2] == 0x9B) printf("PTD - Presentation Text Data Descriptor");
-            else printf("Unknown");
-        }
-        else if (type[1] == 0xB2) {
-            if (type[2] == 0xA7) printf("IEL - Index Element");
-            else if (type[2] == 0x88) printf("PFC - Presentation Fidelity Control");
-            else if (type[2] == 0x90) printf("LLE - Link Logical Element");
-            else if (type[2] == 0xAF) printf("PGP - Page Position");
-            else if (type[2] == 0x9B) printf("PTD - Presentation Text Data Descriptor");
-            else printf("Unknown");
-        }
-        else if (type[1] == 0xB4 && type[2] == 0x90) {
-            printf("LLE - Link Logical Element");
-        }
-        else if (type[1] == 0xEE) {
-            if (type[2] == 0x89) printf("FNG - Font Patterns (FNG)");
-            else if (type[2] == 0xBB) printf("GAD - Graphics Data");
-            else if (type[2] == 0xFB) printf("IPD - Image Picture Data");
-            else if (type[2] == 0xEE) printf("NOP - No Operation");
-            else if (type[2] == 0x92) printf("OCD - Object Container Data");
-            else if (type[2] == 0x9B) printf("PTX - Presentation Text Data");
-            else if (type[2] == 0xEB) printf("BDA - Bar Code Data");
-            else printf("Unknown");
-        }
-        else {
-            printf("Unknown");
-        }
-    } 
-    else if (type[0] == 0xD9) {
-        if (type[1] == 0xEE && type[2] == 0xD3) printf("NOP - No Operation");
-        else printf("Unknown");
-    } 
-    else if (type[0] == 0x5A) {
-        printf("Carriage Control");
-    }
-    else {
-        printf("Unknown");
-    }
-    
-    printf(")\n");
+static int cpu_count(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0)
+        return (int)n;
+#endif
+    return 1;
 }
 
-void print_structure_summary(ComponentStack *stack, int page_count, int object_count, int resource_count) {
-    printf("\nAFP Structure Summary:\n");
-    printf("---------------------\n");
-    
-    if (!stack_empty(stack)) {
-        printf("Warning: Document structure is incomplete. Unclosed components:\n");
-        
-        while (!stack_empty(stack)) {
-            AFPComponent comp = stack_pop(stack);
-            printf("  - %s\n", get_component_name(comp));
-        }
-    } else {
-        printf("Document structure is properly nested and complete.\n");
-    }
-    
-    printf("\nContent Summary:\n");
-    printf("  - Pages: %d\n", page_count);
-    printf("  - Objects: %d\n", object_count);
-    printf("  - Resources: %d\n", resource_count);
+void print_usage(const char *program) {
+    printf("AFP File Validator\n");
+    printf("------------------\n");
+    printf("Usage: %s [options] <afp_file|-|directory>...\n", program);
+    printf("  -: Read the AFP stream from standard input\n");
+    printf("  -v: Verbose mode (print details of each structured field)\n");
+    printf("  --dump-limit <bytes>: Dump at most this many data bytes per field in verbose mode\n");
+    printf("  --deep: Also validate the triplets in field payloads (bounds, lengths, FQN formats)\n");
+    printf("  --structure-only: Check structure, counts and resource names only, stepping over\n");
+    printf("      text, image, graphics and object data (ignored with -v, --deep, --fingerprint)\n");
+    printf("  --stats-perf: Print I/O, allocation and per-phase time counters after the\n");
+    printf("      summary (needs a build with make PERF=1)\n");
+    printf("  --codepage <ccsid>: EBCDIC code page of names and text: 37, 273, 277, 278, 280,\n");
+    printf("      284, 285, 297, 500, 871 or 1047 (default: from Begin Document, else 500)\n");
+    printf("  --extract-text <text_file>: Write the presentation text of every page to\n");
+    printf("      text_file as UTF-8, a form feed after each page (- for standard output,\n");
+    printf("      which then replaces the report)\n");
+    printf("  --follow <idle_seconds>: Validate a single file while it is being written,\n");
+    printf("      reading only the bytes appended since the last check; done once the\n");
+    printf("      file has not grown for idle_seconds\n");
+    printf("  -e <max_errors>: Stop after this many errors (default: no limit)\n");
+    printf("  -i: Write an offset index next to the file (<afp_file>.afpidx) and reuse it\n");
+    printf("      on later runs while the file is unchanged\n");
+    printf("  --page <n>[-<m>]: Validate only page n (or pages n to m) of a single file,\n");
+    printf("      located with the -i index when it is current\n");
+    printf("  --split <documents|pages>: Split a single file into AFP files of one document\n");
+    printf("      or of this many pages of a document each, keeping the print file resources\n");
+    printf("      and the document wrapper; name.afp is written as name-NNNN.afp\n");
+    printf("  --split-prefix <prefix>: Name the parts of --split <prefix>NNNN.afp\n");
+    printf("  --checkpoint <MB>: Save a restart checkpoint (<afp_file>.afpckpt) after every\n");
+    printf("      MB megabytes; the run is then serial\n");
+    printf("  --resume: Continue from the checkpoint of an interrupted run of the same file\n");
+    printf("  --json: Print one JSON summary object per file instead of the text report\n");
+    printf("  --jsonl: Print JSON Lines: an event per error (and per field with -v), then the summary\n");
+    printf("  --fingerprint: Hash every inline resource (BRS, BMO, BPS); a batch reports the\n");
+    printf("      resources that are byte-identical across files and the bytes they waste\n");
+    printf("  -l <list_file>: Validate every file listed in list_file (one path per line)\n");
+    printf("  -j <threads>: Number of worker threads (0 = all cores). A batch spreads files\n");
+    printf("                over the threads; a single large file is split at page boundaries\n");
+    printf("\nThis program validates AFP/MO:DCA files according to the specification.\n");
+    printf("It analyzes the document structure, identifies errors, and provides statistics.\n");
+    printf("Several files, a list file or a directory are validated as a batch and\n");
+    printf("followed by a consolidated summary.\n");
+    printf("Exit status: 0 valid, 1 invalid, 2 unreadable input or bad arguments.\n");
 }
 
-typedef struct {
-    int documents;
-    int page_groups;
-    int pages;
-    int overlays;
-    int resource_groups;
-    int presentation_text;
-    int images;
-    int graphics;
-    int barcodes;
-    int fonts;
-    int form_defs;
-    int page_segments;
-} AFPStatistics;
+// Process exit status
+enum {
+    EXIT_VALID = 0,
+    EXIT_INVALID = 1,
+    EXIT_ERROR = 2 // Bad arguments or unreadable input
+};
 
-void print_statistics(AFPStatistics *stats) {
-    printf("\nAFP Content Statistics:\n");
-    printf("----------------------\n");
-    printf("Documents:         %d\n", stats->documents);
-    printf("Page Groups:       %d\n", stats->page_groups);
-    printf("Pages:             %d\n", stats->pages);
-    printf("Overlays:          %d\n", stats->overlays);
-    printf("Resource Groups:   %d\n", stats->resource_groups);
-    printf("Presentation Text: %d\n", stats->presentation_text);
-    printf("Images:            %d\n", stats->images);
-    printf("Graphics:          %d\n", stats->graphics);
-    printf("Barcodes:          %d\n", stats->barcodes);
-    printf("Fonts:             %d\n", stats->fonts);
-    printf("Form Definitions:  %d\n", stats->form_defs);
-    printf("Page Segments:     %d\n", stats->page_segments);
-}
+// Split a file into parts named <prefix>NNNN.afp; the prefix defaults to
+// the file name without its extension and a dash
+static int split_file(const char *filename, bool use_index, uint32_t pages_per_part, const char *prefix) {
+    char base[4096];
+    if (!prefix) {
+        snprintf(base, sizeof(base), "%s", filename);
+        char *slash = strrchr(base, '/');
+        char *dot = strrchr(slash ? slash : base, '.');
+        if (dot && dot != base && dot[-1] != '/')
+            *dot = '\0';
+        strncat(base, "-", sizeof(base) - strlen(base) - 1);
+        prefix = base;
+    }
 
-void update_statistics(AFPStatistics *stats, StructuredField *field) {
-    // Check Begin structured fields to count objects
-    if (field->type[0] == 0xD3 && field->type[1] == 0xA8) {
-        switch (field->type[2]) {
-            case 0xC6: stats->documents++; break;       // BDT
-            case 0xD6: stats->page_groups++; break;     // BNG
-            case 0xCE: stats->pages++; break;           // BPG
-            case 0xBB: stats->overlays++; break;        // BMO
-            case 0xDF: stats->resource_groups++; break; // BRG
-        }
+    AFPSplitResult result;
+    if (!afp_split(filename, use_index, pages_per_part, prefix, &result)) {
+        printf("Error: %s\n", result.error);
+        if (result.parts > 0)
+            printf("%zu parts were written before the error\n", result.parts);
+        return EXIT_ERROR;
     }
-    
-    // Count data objects
-    if (field->obj_type == OBJ_PRESENTATIONTEXT) stats->presentation_text++;
-    else if (field->obj_type == OBJ_IMAGE) stats->images++;
-    else if (field->obj_type == OBJ_GRAPHICS) stats->graphics++;
-    else if (field->obj_type == OBJ_BARCODE) stats->barcodes++;
-    else if (field->obj_type == OBJ_FONT) stats->fonts++;
-    else if (field->obj_type == OBJ_FORMDEF) stats->form_defs++;
-    else if (field->obj_type == OBJ_PAGSEG) stats->page_segments++;
+    printf("Split %s into %zu part%s: %s0001.afp to %s%04zu.afp\n", filename, result.parts,
+           result.parts == 1 ? "" : "s", prefix, prefix, result.parts);
+    printf("  %llu bytes copied in the kernel, %llu through a buffer, %llu bytes of end fields added\n",
+           (unsigned long long)result.kernel_bytes, (unsigned long long)result.buffered_bytes,
+           (unsigned long long)result.synthesized_bytes);
+    return EXIT_VALID;
 }
 
-void print_logo(){
-    //https://patorjk.com/software/taag/#p=testall&f=Big&t=AfpValidator
-    printf("%s\n","            __   __      __   _ _     _       _             ");
-    printf("%s\n","     /\\    / _|  \\ \\    / /  | (_)   | |     | |            ");
-    printf("%s\n","    /  \\  | |_ _ _\\ \\  / /_ _| |_  __| | __ _| |_ ___  _ __ ");
-    printf("%s\n","   / /\\ \\ |  _| '_ \\ \\/ / _` | | |/ _` |/ _` | __/ _ \\| '__|");
-    printf("%s\n","  / ____ \\| | | |_) \\  / (_| | | | (_| | (_| | || (_) | |   ");
-    printf("%s\n"," /_/    \\_\\_| | .__/ \\/ \\__,_|_|_|\\__,_|\\__,_|\\__\\___/|_|   ");
-    printf("%s\n","              | |                                           ");
-    printf("%s\n","              |_|                      By Began BALAKRISHNAN");
-}
-bool validate_afp_file(const char *filename, bool verbose) {
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        printf("Error: Cannot open file %s\n", filename);
-        return false;
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return EXIT_ERROR;
     }
-
-    bool is_valid = true;
-    int field_count = 0;
-    int error_count = 0;
-    long file_size;
     
-    // Component tracking
-    ComponentStack component_stack;
-    stack_init(&component_stack);
+    FileList files = {0};
+    ValidationOptions options = {.threads = 1, .format = AFP_REPORT_TEXT};
+    bool batch = false;
+    unsigned int first_page = 0, last_page = 0;
+    const char *text_path = NULL;
+    int follow_seconds = -1;
+    long split_pages = -1; // 0 splits per document
+    const char *split_prefix = NULL;
     
-    int page_count = 0;
-    int object_count = 0;
-    int resource_count = 0;
-    
-    // Statistics
-    AFPStatistics stats = {0};
-    
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    file_size = ftell(file);
-    rewind(file);
-
-    print_logo();
-    printf("\n\nAnalyzing AFP file: %s (Size: %ld bytes)\n\n", filename, file_size);
-    
-    unsigned char buffer[4];
-    long position = 0;
-    bool has_begin_document = false;
-    bool has_end_document = false;
-    
-    while (position < file_size) {
-        // Read introducer
-        if (fread(buffer, 1, 1, file) != 1) {
-            if (feof(file)) break;
-            printf("Error: Failed to read introducer at position %ld\n", position);
-            is_valid = false;
-            break;
-        }
-        
-        if (buffer[0] != SF_INTRODUCER) {
-            printf("Error: Invalid structured field introducer (0x%02X) at position %ld\n", 
-                   buffer[0], position);
-            is_valid = false;
-            
-            // Try to recover by seeking to the next byte
-            position++;
-            fseek(file, position, SEEK_SET);
-            error_count++;
-            
-            if (error_count > 10) {
-                printf("Too many errors, stopping analysis\n");
-                break;
-            }
-            continue;
-        }
-        
-        // Read length (2 bytes)
-        if (fread(buffer, 1, 2, file) != 2) {
-            printf("Error: Failed to read length at position %ld\n", position + 1);
-            is_valid = false;
-            break;
-        }
-        
-        uint16_t length = (buffer[0] << 8) | buffer[1];
-        
-        // Validate length
-        if (length < 5) {
-            printf("Error: Invalid length (%d) at position %ld - too short\n", length, position + 1);
-            is_valid = false;
-            position += 3;
-            fseek(file, position, SEEK_SET);
-            error_count++;
-            continue;
-        }
-        
-        if (position + length > file_size) {
-            printf("Error: Invalid length (%d) at position %ld - exceeds file size\n", 
-                   length, position + 1);
-            is_valid = false;
-            position += 3;
-            fseek(file, position, SEEK_SET);
-            error_count++;
-            continue;
-        }
+    for (int i = 1; i < argc; i++) {
+        bool is_directory = false;
+        bool ok = true;
         
-        // Read type (3 bytes)
-        unsigned char type[3];
-        if (fread(type, 1, 3, file) != 3) {
-            printf("Error: Failed to read type at position %ld\n", position + 3);
-            is_valid = false;
-            break;
-        }
-        
-        // Read flag byte
-        unsigned char flag = 0;
-        if (fread(&flag, 1, 1, file) != 1) {
-            printf("Error: Failed to read flag byte at position %ld\n", position + 6);
-            is_valid = false;
-            break;
-        }
-        
-        // Allocate memory for data
-        unsigned char *data = NULL;
-        int data_length = length - 6; // Introducer(1) + length(2) + type(3) + flag(1) - 1
-        
-        if (data_length > 0) {
-            data = malloc(data_length);
-            if (!data) {
-                printf("Error: Memory allocation failed\n");
-                is_valid = false;
-                break;
+        if (strcmp(argv[i], "-v") == 0) {
+            options.verbose = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            options.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--page") == 0 && i + 1 < argc) {
+            int fields = sscanf(argv[++i], "%u-%u", &first_page, &last_page);
+            if (fields == 1)
+                last_page = first_page;
+            if (fields < 1 || first_page == 0 || last_page < first_page) {
+                printf("Error: Invalid page range %s\n", argv[i]);
+                file_list_free(&files);
+                return EXIT_ERROR;
             }
-            
-            if (fread(data, 1, data_length, file) != data_length) {
-                printf("Error: Failed to read data at position %ld\n", position + 7);
-                free(data);
-                is_valid = false;
-                break;
+        } else if (strcmp(argv[i], "--dump-limit") == 0 && i + 1 < argc) {
+            options.dump_limit = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--json") == 0) {
+            options.format = AFP_REPORT_JSON;
+        } else if (strcmp(argv[i], "--jsonl") == 0) {
+            options.format = AFP_REPORT_JSONL;
+        } else if (strcmp(argv[i], "--fingerprint") == 0) {
+            options.fingerprint = true;
+        } else if (strcmp(argv[i], "--deep") == 0) {
+            options.deep = true;
+        } else if (strcmp(argv[i], "--structure-only") == 0) {
+            options.structure_only = true;
+        } else if (strcmp(argv[i], "--stats-perf") == 0) {
+            options.stats_perf = true;
+        } else if (strcmp(argv[i], "--codepage") == 0 && i + 1 < argc) {
+            options.codepage = atoi(argv[++i]);
+            if (!afp_codepage_name(options.codepage)) {
+                printf("Error: Unsupported code page %s\n", argv[i]);
+                file_list_free(&files);
+                return EXIT_ERROR;
             }
-        }
-        
-        // Prepare structured field
-        StructuredField field;
-        field.length = length;
-        memcpy(field.type, type, 3);
-        field.flags = flag;
-        field.data = data;
-        memset(field.name, 0, sizeof(field.name));
-        
-        // Identify field type and component
-        identify_field_type(&field);
-        
-        // Check for Begin Document and End Document
-        if (type[0] == 0xD3) {
-            if(type[1] == 0xA8) {
-                if (type[2] == 0xA8) { // BDT
-                    has_begin_document = true;
-                    stack_push(&component_stack, COMPONENT_DOCUMENT);
-                }
-                else if (type[2] == 0xAD) { // BNG - Begin Named Page Group
-                    stack_push(&component_stack, COMPONENT_PAGE_GROUP);
-                }
-                else if (type[2] == 0xAF) { // BPG - Begin Page
-                    stack_push(&component_stack, COMPONENT_PAGE);
-                    page_count++;
-                }
-                else if (type[2] == 0xC9) { // BAG - Begin Active Environment Group
-                    stack_push(&component_stack, COMPONENT_OBJECT);
-                    object_count++;
-                }
-                else if (type[2] == 0xC6) { // BRG - Begin Resource Group
-                    stack_push(&component_stack, COMPONENT_RESOURCE_GROUP);
-                }
-                else if (type[2] == 0xDF) { // BMO - Begin Medium Overlay
-                    stack_push(&component_stack, COMPONENT_OVERLAY);
-                }
-            } else if(type[1] == 0xA9) {
-                if (type[2] == 0xA8) { // EDT
-                    has_end_document = true;
-                    AFPComponent popped = stack_pop(&component_stack);
-                    if (popped != COMPONENT_DOCUMENT) {
-                        printf("Error: Document structure mismatch at position %ld\n", position);
-                        printf("       Expected to end %s but found End Document\n", 
-                            get_component_name(popped));
-                        is_valid = false;
-                    }
-                }
-                else if (type[2] == 0xAD) { // ENG - End Named Page Group
-                    AFPComponent popped = stack_pop(&component_stack);
-                    if (popped != COMPONENT_PAGE_GROUP) {
-                        printf("Error: Document structure mismatch at position %ld\n", position);
-                        printf("       Expected to end %s but found End Page Group\n", 
-                            get_component_name(popped));
-                        is_valid = false;
-                    }
-                }
-                else if (type[2] == 0xAF) { // EPG - End Page
-                    AFPComponent popped = stack_pop(&component_stack);
-                    if (popped != COMPONENT_PAGE) {
-                        printf("Error: Document structure mismatch at position %ld\n", position);
-                        printf("       Expected to end %s but found End Page\n", 
-                            get_component_name(popped));
-                        is_valid = false;
-                    }
-                }
-                else if (type[2] == 0xC9) { // EAG - End Active Environment Group
-                    AFPComponent popped = stack_pop(&component_stack);
-                    if (popped != COMPONENT_OBJECT) {
-                        printf("Error: Document structure mismatch at position %ld\n", position);
-                        printf("       Expected to end %s but found End Active Environment Group\n", 
-                            get_component_name(popped));
-                        is_valid = false;
-                    }
-                }
-                else if (type[2] == 0xC6) { // ERG - End Resource Group
-                    AFPComponent popped = stack_pop(&component_stack);
-                    if (popped != COMPONENT_RESOURCE_GROUP) {
-                        printf("Error: Document structure mismatch at position %ld\n", position);
-                        printf("       Expected to end %s but found End Resource Group\n", 
-                            get_component_name(popped));
-                        is_valid = false;
-                    }
-                }
-                else if (type[2] == 0xDF) { // EMO - End Medium Overlay
-                    AFPComponent popped = stack_pop(&component_stack);
-                    if (popped != COMPONENT_OVERLAY) {
-                        printf("Error: Document structure mismatch at position %ld\n", position);
-                        printf("       Expected to end %s but found End Medium Overlay\n", 
-                            get_component_name(popped));
-                        is_valid = false;
-                    }
-                }
-            }
-        }
-        
-        // Count resource
-        if (field.component == COMPONENT_RESOURCE) {
-            resource_count++;
-        }
-        
-        // Update statistics
-        update_statistics(&stats, &field);
-        
-        // Print field information
-        if (verbose) {
-            printf("Field #%d at position %ld:\n", field_count + 1, position);
-            printf("  Introducer: 0x5A\n");
-            printf("  Length: %d\n", length);
-            printf("  Flag: 0x%02X\n", flag);
-            printf("  ");
-            print_ebcdic_type(type);
-            
-            if (field.component != COMPONENT_UNKNOWN) {
-                printf("  Component: %s\n", get_component_name(field.component));
+        } else if (strcmp(argv[i], "--extract-text") == 0 && i + 1 < argc) {
+            text_path = argv[++i];
+        } else if (strcmp(argv[i], "--follow") == 0 && i + 1 < argc) {
+            follow_seconds = atoi(argv[++i]);
+            if (follow_seconds < 0) {
+                printf("Error: Invalid idle time %s\n", argv[i]);
+                file_list_free(&files);
+                return EXIT_ERROR;
             }
-            
-            if (field.obj_type != OBJ_UNKNOWN) {
-                printf("  Object Type: %s\n", get_object_type_name(field.obj_type));
+        } else if (strcmp(argv[i], "--split") == 0 && i + 1 < argc) {
+            i++;
+            split_pages = strcmp(argv[i], "documents") == 0 ? 0 : strtol(argv[i], NULL, 10);
+            if (split_pages <= 0 && strcmp(argv[i], "documents") != 0) {
+                printf("Error: Invalid split size %s\n", argv[i]);
+                file_list_free(&files);
+                return EXIT_ERROR;
             }
-            
-            if (field.name[0] != 0) {
-                printf("  Resource Name: ");
-                print_ebcdic_string((unsigned char*)field.name, strlen(field.name));
+        } else if (strcmp(argv[i], "--split-prefix") == 0 && i + 1 < argc) {
+            split_prefix = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            unsigned long megabytes = strtoul(argv[++i], NULL, 10);
+            if (megabytes == 0) {
+                printf("Error: Invalid checkpoint interval %s\n", argv[i]);
+                file_list_free(&files);
+                return EXIT_ERROR;
             }
-            
-            printf("  Data: ");
-            if (data_length > 0) {
-                print_hex(data, data_length);
-                // Additional interpretation for common field types
-                if (field.type[0] == 0xD3 && field.type[1] == 0xA8 && field.type[2] == 0xC6) {
-                    // Document name for BDT
-                    if (data_length >= 8) {
-                        printf("  Document Name: ");
-                        print_ebcdic_string(data, 8);
-                    }
-                }
-            } else {
-                printf("(none)\n");
+            options.checkpoint_bytes = (uint64_t)megabytes * 1000000;
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            options.resume = true;
+        } else if (strcmp(argv[i], "-i") == 0) {
+            options.index = true;
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            options.max_errors = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            batch = true;
+            if (!file_list_add_listfile(&files, argv[++i])) {
+                printf("Error: Cannot read list file %s\n", argv[i]);
+                file_list_free(&files);
+                return EXIT_ERROR;
             }
-            printf("\n");
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            printf("Error: Unknown option %s\n\n", argv[i]);
+            print_usage(argv[0]);
+            file_list_free(&files);
+            return EXIT_ERROR;
+        } else {
+            ok = file_list_add_path(&files, argv[i], &is_directory);
+            batch = batch || is_directory;
         }
         
-        // Free allocated memory
-        if (data) {
-            free(data);
+        if (!ok) {
+            printf("Error: Memory allocation failed\n");
+            file_list_free(&files);
+            return EXIT_ERROR;
         }
-        
-        field_count++;
-        position += length;
     }
     
-    fclose(file);
-    
-    // Summary
-    printf("\nAFP File Analysis Summary:\n");
-    printf("-------------------------\n");
-    printf("Total structured fields: %d\n", field_count);
-    printf("Errors detected: %d\n", error_count);
-    printf("Begin Document found: %s\n", has_begin_document ? "Yes" : "No");
-    printf("End Document found: %s\n", has_end_document ? "Yes" : "No");
-    
-    if (!has_begin_document) {
-        printf("Warning: No Begin Document structured field found\n");
+    if (files.count == 0) {
+        print_usage(argv[0]);
+        file_list_free(&files);
+        return EXIT_ERROR;
     }
     
-    if (!has_end_document) {
-        printf("Warning: No End Document structured field found\n");
+    if (options.threads <= 0) {
+        options.threads = cpu_count();
     }
     
-    // Print structure summary
-    print_structure_summary(&component_stack, page_count, object_count, resource_count);
+    if (first_page > 0 && (batch || files.count > 1)) {
+        printf("Error: --page selects pages of a single file\n");
+        file_list_free(&files);
+        return EXIT_ERROR;
+    }
     
-    // Print statistics
-    print_statistics(&stats);
+    if (text_path && (batch || files.count > 1)) {
+        printf("Error: --extract-text takes a single file\n");
+        file_list_free(&files);
+        return EXIT_ERROR;
+    }
     
-    printf("\nValidation result: %s\n", is_valid ? "VALID" : "INVALID");
+    if (follow_seconds >= 0 && (batch || files.count > 1 || first_page > 0)) {
+        printf("Error: --follow takes a single file and no --page\n");
+        file_list_free(&files);
+        return EXIT_ERROR;
+    }
     
-    return is_valid;
-}
-
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("AFP File Validator\n");
-        printf("------------------\n");
-        printf("Usage: %s <afp_file> [-v]\n", argv[0]);
-        printf("  -v: Verbose mode (print details of each structured field)\n");
-        printf("\nThis program validates AFP/MO:DCA files according to the specification.\n");
-        printf("It analyzes the document structure, identifies errors, and provides statistics.\n");
-        return 1;
+    if (split_pages >= 0 && (batch || files.count > 1 || first_page > 0 || text_path || follow_seconds >= 0)) {
+        printf("Error: --split takes a single file and no --page, --extract-text or --follow\n");
+        file_list_free(&files);
+        return EXIT_ERROR;
     }
     
-    const char *filename = argv[1];
-    bool verbose = false;
+    // Text on standard output replaces the report
+    FILE *text = NULL;
+    if (text_path) {
+        text = strcmp(text_path, "-") == 0 ? stdout : fopen(text_path, "wb");
+        if (!text) {
+            printf("Error: Cannot create text file %s\n", text_path);
+            file_list_free(&files);
+            return EXIT_ERROR;
+        }
+    }
+    FILE *report = text == stdout ? NULL : stdout;
     
-    if (argc > 2 && strcmp(argv[2], "-v") == 0) {
-        verbose = true;
+    // JSON output stays parseable
+    if (options.format == AFP_REPORT_TEXT && report) {
+        print_logo();
     }
     
-    validate_afp_file(filename, verbose);
+    int status;
+    if (split_pages >= 0) {
+        status = split_file(files.items[0], options.index, (uint32_t)split_pages, split_prefix);
+    } else if (text || follow_seconds >= 0) {
+        ValidationResult result;
+        AFPValidator *validator = afp_validator_create(&options);
+        if (!validator) {
+            printf("Error: Memory allocation failed\n");
+            file_list_free(&files);
+            return EXIT_ERROR;
+        }
+        afp_validator_set_output(validator, report);
+        afp_validator_set_text_output(validator, text);
+        if (follow_seconds >= 0)
+            afp_validator_follow(validator, files.items[0], (unsigned)follow_seconds, &result);
+        else if (first_page > 0)
+            afp_validator_run_pages(validator, files.items[0], first_page, last_page, &result);
+        else
+            afp_validator_run(validator, files.items[0], &result);
+        afp_validator_destroy(validator);
+        status = !result.opened ? EXIT_ERROR : result.is_valid ? EXIT_VALID : EXIT_INVALID;
+        
+        bool written = !text || !ferror(text);
+        if (text && text != stdout && fclose(text) != 0)
+            written = false;
+        if (!written) {
+            printf("Error: Cannot write text file %s\n", text_path);
+            status = EXIT_ERROR;
+        }
+    } else if (!batch && files.count == 1) {
+        ValidationResult result;
+        if (first_page > 0)
+            validate_pages(files.items[0], &options, first_page, last_page, stdout, &result);
+        else
+            validate_afp_file(files.items[0], &options, stdout, &result);
+        status = !result.opened ? EXIT_ERROR : result.is_valid ? EXIT_VALID : EXIT_INVALID;
+    } else {
+        // Batch statuses use the same values
+        status = validate_batch((const char **)files.items, files.count, &options, stdout);
+    }
     
-    return 0;
-}
\ No newline at end of file
+    file_list_free(&files);
+    return status;
+}
@@ -0,0 +1,157 @@
+// AFP/MO:DCA validation library.
+//
+// A validator walks the structured fields of an AFP file or buffer, checks
+// their framing and the nesting of the main containers and collects
+// statistics. Results are returned in ValidationResult and, optionally, as a
+// text report written to a caller-supplied stream and as visitor callbacks.
+// The library never writes to stdout or stderr on its own.
+#ifndef AFPVALIDATOR_H
+#define AFPVALIDATOR_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Report formats
+typedef enum {
+    AFP_REPORT_TEXT,
+    AFP_REPORT_JSON,  // One summary object per input, one per line
+    AFP_REPORT_JSONL  // JSON Lines: error events (field events too when verbose), then the summary
+} AFPReportFormat;
+
+// Options controlling a validation run
+typedef struct {
+    bool verbose;
+    int threads;    // Threads splitting a single file at page boundaries (1 = serial)
+    int max_errors; // Stop after this many errors (0 = no limit); limited runs are serial
+    bool index;     // Write the .afpidx sidecar, or reuse it while the file is unchanged
+    size_t dump_limit; // Verbose mode: data bytes dumped per field (0 = all)
+    AFPReportFormat format;
+    bool fingerprint; // Hash every inline resource; a batch reports identical ones across files
+    bool deep;        // Also check the triplets carried in field payloads
+    bool structure_only; // Read only headers, names and resource references (ignored with
+                         // verbose, fingerprint and deep, which need the payloads)
+    bool stats_perf;  // Report I/O, allocation and per-phase time counters (builds with AFP_PERF)
+    int codepage;     // CCSID of names and text (0 = from the document, else 500)
+    uint64_t checkpoint_bytes; // Save a restart checkpoint (<afp_file>.afpckpt) every this many bytes
+                               // (0 = none); checkpointed runs are serial
+    bool resume;      // Continue from the checkpoint of an earlier run, when it matches the file
+} ValidationOptions;
+
+// Outcome of one validation run
+typedef struct {
+    bool opened;
+    bool is_valid;
+    uint64_t field_count;
+    uint64_t error_count;
+    uint64_t file_size;
+} ValidationResult;
+
+// A structured field as seen by visitor callbacks. Pointers are only valid
+// during the callback.
+typedef struct {
+    uint64_t offset;            // Offset of the 0x5A introducer
+    uint16_t length;            // Length field: everything after the introducer
+    unsigned char type[3];
+    unsigned char flags;
+    const unsigned char *data;  // Bytes after the flag byte (reserved bytes, then payload),
+                                // NULL when structure_only skipped them
+    size_t data_length;
+    const char *acronym;        // "BPG", or "" for an unknown type
+    const char *type_name;      // "Begin Page", or "Unknown"
+} AFPField;
+
+// Push-style callbacks, each optional. depth is the nesting of the main
+// containers (document, page group, page, ...) around the field.
+typedef struct {
+    void (*on_field)(void *user, const AFPField *field);
+    void (*on_begin)(void *user, const AFPField *field, int depth);
+    void (*on_end)(void *user, const AFPField *field, int depth);
+    void (*on_error)(void *user, uint64_t position, const char *message);
+} AFPVisitor;
+
+// Validation context. It holds the options, the report stream and the
+// visitor, and can run any number of validations one after the other.
+typedef struct AFPValidator AFPValidator;
+
+AFPValidator *afp_validator_create(const ValidationOptions *options);
+void afp_validator_destroy(AFPValidator *validator);
+
+// Text report destination; NULL (the default) writes no report
+void afp_validator_set_output(AFPValidator *validator, FILE *out);
+// Presentation text destination: the text of every page as UTF-8, a line
+// per baseline and a form feed after each page. NULL (the default) extracts
+// nothing. Runs with text are serial and otherwise read only the text
+// payloads, unless verbose, fingerprint or deep need the rest.
+void afp_validator_set_text_output(AFPValidator *validator, FILE *text);
+void afp_validator_set_visitor(AFPValidator *validator, const AFPVisitor *visitor, void *user);
+
+// Validate a file ("-" reads standard input), an AFP buffer held in memory,
+// or only pages first..last (1-based, inclusive) of a file. Return whether
+// the input is valid; result may be NULL.
+bool afp_validator_run(AFPValidator *validator, const char *filename, ValidationResult *result);
+bool afp_validator_run_buffer(AFPValidator *validator, const unsigned char *data, size_t size,
+                              ValidationResult *result);
+bool afp_validator_run_pages(AFPValidator *validator, const char *filename, uint32_t first, uint32_t last,
+                             ValidationResult *result);
+
+// Validate a file that another process is still appending to. Each time
+// the file grows, validation resumes at the first field the last pass could
+// not finish, so only new bytes are read; a field still being written is
+// waited for. Once the size has not changed for idle_seconds, a last pass
+// reports what is incomplete and the summary is written.
+bool afp_validator_follow(AFPValidator *validator, const char *filename, unsigned idle_seconds,
+                          ValidationResult *result);
+
+// Byte range [*start, *end) of pages first..last of a file, located with its
+// sidecar index when use_index is set and the index is current
+bool afp_find_pages(const char *filename, bool use_index, uint32_t first, uint32_t last,
+                    uint64_t *start, uint64_t *end);
+
+// Outcome of afp_split
+typedef struct {
+    size_t parts;               // Part files written
+    uint64_t kernel_bytes;      // Copied from the input inside the kernel
+    uint64_t buffered_bytes;    // Copied through a buffer where the kernel cannot
+    uint64_t synthesized_bytes; // End fields written to close the parts
+    char error[256];            // Why the split stopped, "" when it did not
+} AFPSplitResult;
+
+// Split a file into AFP files of their own: one per document, or one per
+// pages_per_part pages of a document (0 for one per document). Every part
+// repeats the bytes before the first document (the print file resources).
+// A part that starts after the first page of its document then repeats the
+// document head (Begin Document up to the first page or page group, with
+// the resource group and medium map there), the begin fields still open at
+// its first page and the last Invoke Medium Map before it. Every part ends
+// with end fields for what is still open. Part n is written to
+// <prefix>NNNN.afp. The page table comes from the sidecar index when
+// use_index is set and the index is current.
+bool afp_split(const char *filename, bool use_index, uint32_t pages_per_part, const char *prefix,
+               AFPSplitResult *result);
+
+// Name of a supported EBCDIC code page for ValidationOptions.codepage, NULL
+// for an unsupported CCSID
+const char *afp_codepage_name(int ccsid);
+
+// One-shot helpers writing the text report to out
+bool validate_afp_file(const char *filename, const ValidationOptions *options, FILE *out, ValidationResult *result);
+bool validate_pages(const char *filename, const ValidationOptions *options, uint32_t first, uint32_t last,
+                    FILE *out, ValidationResult *result);
+
+// Validate many files on options->threads worker threads, writing the
+// reports in input order and a consolidated summary to out. Returns the
+// worst per-file status: 0 valid, 1 invalid, 2 unreadable. An empty batch
+// writes nothing and returns 0.
+int validate_batch(const char **filenames, size_t count, const ValidationOptions *options, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AFPVALIDATOR_H